@@ -0,0 +1,1066 @@
+/****************************************************************************
+  ARAP benchmark on procedurally generated meshes :
+
+  arapBenchmark [options]
+
+  Generates each shape at each size, sets bend/stretch handles on it and
+  times the solver phases. Options :
+    --shapes list        among sphere, grid, cylinder (all of them)
+    --sizes list         approximate vertex counts (10000,100000,1000000)
+    --threads list       thread counts, one run per count (all the cores)
+    --iterations N       ARAP iterations of the deformation (5)
+    --hard               hard handle constraints
+    --solver s           cholesky or cg, the conjugate gradient (cholesky)
+    --cg                 same as --solver cg
+    --preconditioner p   jacobi or ic, the incomplete Cholesky factor, of the
+                         conjugate gradient (jacobi)
+    --levels N           multiresolution levels (1)
+    --anderson list      Anderson windows, one run per window (0, plain
+                         local-global iterations)
+    --cluster-size list  vertices per rotation of the local step, one run per
+                         size (1, a rotation per vertex)
+    --tolerance t        convergence tolerance stopping the iterations
+                         before --iterations (0, never)
+    --factorization list among auto, simplicial and supernodal, one run per
+                         factorization (auto)
+    --ordering list      among auto, amd, metis and nesdis, one run per
+                         ordering (auto)
+    --table              writes the runs as a text table instead of JSON
+    --check-allocations  counts the heap allocations of a drag of the handles
+                         once warmed up, fails if there are any
+    --check-batch N      deforms N frames with compute_deformations and
+                         compares them with compute_deformation
+    --check-rotations N  checks the rotation fitting on N covariances of each
+                         kind instead of benchmarking the meshes
+    --check-preconditioners N  deforms a cylinder of about N vertices and an
+                         unreferenced vertex with the conjugate gradient
+                         instead of benchmarking the meshes
+    --handle-changes list  numbers of handles added to the handle set, each
+                         timed as low-rank updates of the factorization and
+                         as a full factorization (none)
+
+  Lists are comma separated, e.g. --sizes 10000,10000000.
+
+  sphere   : subdivided icosahedron, the bottom cap is fixed and the top
+             cap pulled up
+  grid     : square sheet, one side is fixed and the opposite one lifted
+  cylinder : open tube, the bottom ring is fixed and the top ring bent by
+             a quarter turn
+
+  Each run writes one JSON object per line on the standard output :
+  generate_ms, init_ms, set_handles_ms and deform_ms are the times of the
+  calls, adjacency_ms the one-ring and cotangent weights part of init_ms,
+  analyze_ms and factorize_ms the two parts of set_handles_ms,
+  rhs_ms, solve_ms and rotations_ms the mean times per iteration of the
+  three phases of an ARAP iteration on the finest level, followed by the
+  size of the system and of its factor (AsRigidAsPossible::Stats), the
+  ordering CHOLMOD used for it (factor_ordering) and whether it is
+  supernodal, the
+  incomplete Cholesky factor of the conjugate gradient counting as the
+  factor. cg_iterations is the total of the conjugate gradient iterations of
+  the deformation (in soft mode the Jacobi preconditioned solves commonly
+  stop at the limit of 1000 iterations, see --preconditioner ic),
+  peak_rss_kb the peak resident memory of the process so
+  far : compare the solvers' memory with one run per process, e.g.
+  --solver cholesky and --solver cg on the same size.
+  --table writes one row per run with the columns comparing the
+  factorizations and orderings instead (the --check-allocations and
+  --handle-changes lines stay JSON), e.g.
+    arapBenchmark --factorization simplicial,supernodal --ordering amd,metis,nesdis --table
+  The Factorization and Ordering defaults of AsRigidAsPossible are AUTO,
+  CHOLMOD's own choices : they have not been tuned with this table.
+
+  With a tolerance, iterations is the number of iterations it took to
+  converge, e.g. --iterations 200 --tolerance 1e-5 --anderson 0,5 compares
+  it with and without Anderson acceleration.
+
+  cluster_size and rotation_clusters give the rotation clusters of the
+  local step : --cluster-size 1,4,16 compares rotations_ms and the energy
+  of the deformation with fewer rotations.
+
+  With --handle-changes, each count k adds one more JSON line per run :
+  update_ms and refactor_ms are the times of setHandles applying k more
+  handles by low-rank updates (updated is false when CHOLMOD refused them)
+  and by a full factorization, deform_updated_ms and deform_refactored_ms
+  the deformations solved with the resulting factors.
+
+  With --check-allocations, each run adds a JSON line with the heap
+  allocations of compute_deformation over a drag of the handles, after the
+  timed deformation has allocated the workspaces. Every malloc is counted
+  with the GNU C library, CHOLMOD's included, only operator new otherwise.
+  The exit status is a failure when any run allocates.
+
+  With --check-batch, each run adds a JSON line comparing the N frames of a
+  drag of the handles deformed by one compute_deformations call, on the
+  threads of the run, with the same frames deformed one compute_deformation
+  at a time by fresh solvers, one per run of frames of compute_deformations
+  with the threads it gives that run : batch_difference is the largest distance
+  between their positions, 0 in practice, and matched is false above 1e-6.
+  The exit status is then a failure, e.g.
+    arapBenchmark --threads 1,4 --sizes 10000 --check-batch 8 --hard
+
+  --check-rotations compares, on generated covariances S = Q1 diag(d) Q2 of
+  each kind (generic, reflected with det(S) < 0, near-rigid, planar,
+  collinear and zero), the rotations of RotationFitting::closestRotation in
+  double, of the batched float closestRotations of the local step and of the
+  GSL SVD they replaced with the exact ones : largest coefficient error when
+  the closest rotation is unique, shortfall of trace(R S) from its maximum
+  and orthonormality error. One JSON line per kind also gives the time per
+  covariance of each. The exit status is a failure when the double kernel
+  is off by more than 1e-9 or the batched one by more than 1e-4.
+
+  --check-preconditioners writes one JSON line per constraint mode and
+  preconditioner of the conjugate gradient, the unreferenced vertex leaving
+  an empty row in the system. The exit status is a failure when setHandles
+  fails or a deformed position is not finite.
+*****************************************************************************/
+#include "AsRigidAsPossible.h"
+#include "RotationFitting.h"
+
+#include <gsl/gsl_blas.h>
+#include <gsl/gsl_linalg.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <new>
+#include <random>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <sys/resource.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#ifndef ARAP_REVISION
+#define ARAP_REVISION "unknown"
+#endif
+
+// heap allocations made while allocationCounting is set
+static std::atomic<bool> allocationCounting( false );
+static std::atomic<size_t> allocationNb( 0 );
+
+#ifdef __GLIBC__
+extern "C" {
+void * __libc_malloc( size_t size );
+void * __libc_calloc( size_t count, size_t size );
+void * __libc_realloc( void * pointer, size_t size );
+
+void * malloc( size_t size ){
+    if( allocationCounting ) allocationNb++;
+    return __libc_malloc( size );
+}
+
+void * calloc( size_t count, size_t size ){
+    if( allocationCounting ) allocationNb++;
+    return __libc_calloc( count, size );
+}
+
+void * realloc( void * pointer, size_t size ){
+    if( allocationCounting ) allocationNb++;
+    return __libc_realloc( pointer, size );
+}
+}
+#else
+void * operator new( size_t size ){
+    if( allocationCounting ) allocationNb++;
+    void * pointer = std::malloc( size );
+    if( pointer == NULL ) throw std::bad_alloc();
+    return pointer;
+}
+
+void * operator new[]( size_t size ){ return operator new( size ); }
+void operator delete( void * pointer ) noexcept { std::free( pointer ); }
+void operator delete[]( void * pointer ) noexcept { std::free( pointer ); }
+#endif
+
+struct BenchmarkMesh
+{
+    std::vector<Vec3Df> vertices;
+    std::vector<Triangle> triangles;
+    std::vector<bool> handles;
+    std::vector<Vec3Df> positions;
+
+    void setHandle( unsigned int i, const Vec3Df & position ){
+        handles[i] = true;
+        positions[i] = position;
+    }
+};
+
+// peak resident memory of the process
+static long peakResidentKb(){
+    struct rusage usage;
+    getrusage( RUSAGE_SELF, &usage );
+    return usage.ru_maxrss;
+}
+
+static double elapsedMs( const std::chrono::steady_clock::time_point & start ){
+    return std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+}
+
+static unsigned int midpoint( unsigned int a, unsigned int b, std::vector<Vec3Df> & vertices,
+                              std::unordered_map< unsigned long long, unsigned int > & midpoints ){
+    unsigned long long key = ( (unsigned long long)std::min( a, b ) << 32 ) | std::max( a, b );
+    std::unordered_map< unsigned long long, unsigned int >::iterator it = midpoints.find( key );
+    if( it != midpoints.end() )
+        return it->second;
+
+    Vec3Df p = vertices[a] + vertices[b];
+    p.normalize();
+    vertices.push_back( p );
+    midpoints[key] = vertices.size() - 1;
+    return vertices.size() - 1;
+}
+
+// icosahedron subdivided until it has about size vertices (10*4^k+2)
+static void generateSphere( unsigned int size, BenchmarkMesh & mesh ){
+    const float t = ( 1.f + sqrt( 5.f ) ) / 2.f;
+    const float icoVertices[12][3] = { {-1, t, 0}, {1, t, 0}, {-1, -t, 0}, {1, -t, 0},
+                                       {0, -1, t}, {0, 1, t}, {0, -1, -t}, {0, 1, -t},
+                                       {t, 0, -1}, {t, 0, 1}, {-t, 0, -1}, {-t, 0, 1} };
+    const unsigned int icoTriangles[20][3] = { {0, 11, 5}, {0, 5, 1}, {0, 1, 7}, {0, 7, 10}, {0, 10, 11},
+                                               {1, 5, 9}, {5, 11, 4}, {11, 10, 2}, {10, 7, 6}, {7, 1, 8},
+                                               {3, 9, 4}, {3, 4, 2}, {3, 2, 6}, {3, 6, 8}, {3, 8, 9},
+                                               {4, 9, 5}, {2, 4, 11}, {6, 2, 10}, {8, 6, 7}, {9, 8, 1} };
+
+    unsigned int subdivisions = 0;
+    while( 10. * pow( 4., subdivisions + 0.5 ) + 2. < size )
+        subdivisions++;
+
+    std::vector<Vec3Df> & vertices = mesh.vertices;
+    std::vector<Triangle> & triangles = mesh.triangles;
+    for( int i = 0 ; i < 12 ; i++ ){
+        vertices.push_back( Vec3Df( icoVertices[i][0], icoVertices[i][1], icoVertices[i][2] ) );
+        vertices.back().normalize();
+    }
+    for( int i = 0 ; i < 20 ; i++ )
+        triangles.push_back( Triangle( icoTriangles[i][0], icoTriangles[i][1], icoTriangles[i][2] ) );
+
+    for( unsigned int s = 0 ; s < subdivisions ; s++ ){
+        std::unordered_map< unsigned long long, unsigned int > midpoints;
+        midpoints.reserve( triangles.size() * 3 / 2 );
+        vertices.reserve( vertices.size() + triangles.size() * 3 / 2 );
+
+        std::vector<Triangle> subdivided;
+        subdivided.reserve( triangles.size() * 4 );
+        for( unsigned int i = 0 ; i < triangles.size() ; i++ ){
+            unsigned int v0 = triangles[i].getVertex(0), v1 = triangles[i].getVertex(1), v2 = triangles[i].getVertex(2);
+            unsigned int m01 = midpoint( v0, v1, vertices, midpoints );
+            unsigned int m12 = midpoint( v1, v2, vertices, midpoints );
+            unsigned int m20 = midpoint( v2, v0, vertices, midpoints );
+            subdivided.push_back( Triangle( v0, m01, m20 ) );
+            subdivided.push_back( Triangle( v1, m12, m01 ) );
+            subdivided.push_back( Triangle( v2, m20, m12 ) );
+            subdivided.push_back( Triangle( m01, m12, m20 ) );
+        }
+        triangles.swap( subdivided );
+    }
+
+    mesh.positions = vertices;
+    mesh.handles.assign( vertices.size(), false );
+    for( unsigned int i = 0 ; i < vertices.size() ; i++ ){
+        if( vertices[i][2] < -0.8f )
+            mesh.setHandle( i, vertices[i] );
+        else if( vertices[i][2] > 0.8f )
+            mesh.setHandle( i, vertices[i] + Vec3Df( 0.f, 0.f, 0.5f ) );
+    }
+}
+
+// side x side vertices on the unit square
+static void generateGrid( unsigned int size, BenchmarkMesh & mesh ){
+    const unsigned int side = std::max( 2u, (unsigned int)( sqrt( (double)size ) + 0.5 ) );
+    const float spacing = 1.f / ( side - 1 );
+
+    mesh.vertices.reserve( side * side );
+    for( unsigned int y = 0 ; y < side ; y++ )
+        for( unsigned int x = 0 ; x < side ; x++ )
+            mesh.vertices.push_back( Vec3Df( x * spacing, y * spacing, 0.f ) );
+
+    mesh.triangles.reserve( 2 * ( side - 1 ) * ( side - 1 ) );
+    for( unsigned int y = 0 ; y + 1 < side ; y++ ){
+        for( unsigned int x = 0 ; x + 1 < side ; x++ ){
+            unsigned int v = y * side + x;
+            mesh.triangles.push_back( Triangle( v, v + 1, v + side + 1 ) );
+            mesh.triangles.push_back( Triangle( v, v + side + 1, v + side ) );
+        }
+    }
+
+    mesh.positions = mesh.vertices;
+    mesh.handles.assign( mesh.vertices.size(), false );
+    for( unsigned int y = 0 ; y < side ; y++ ){
+        mesh.setHandle( y * side, mesh.vertices[y * side] );
+        mesh.setHandle( y * side + side - 1, mesh.vertices[y * side + side - 1] + Vec3Df( 0.f, 0.f, 0.3f ) );
+    }
+}
+
+// open tube of radius 1 and height 4 along z, with square-ish triangles
+static void generateCylinder( unsigned int size, BenchmarkMesh & mesh ){
+    const float height = 4.f;
+    const unsigned int segments = std::max( 3u, (unsigned int)( sqrt( size * 2. * M_PI / height ) + 0.5 ) );
+    const unsigned int rings = std::max( 2u, ( size + segments / 2 ) / segments );
+
+    mesh.vertices.reserve( rings * segments );
+    for( unsigned int r = 0 ; r < rings ; r++ ){
+        float z = height * r / ( rings - 1 );
+        for( unsigned int s = 0 ; s < segments ; s++ ){
+            float angle = 2.f * M_PI * s / segments;
+            mesh.vertices.push_back( Vec3Df( cos( angle ), sin( angle ), z ) );
+        }
+    }
+
+    mesh.triangles.reserve( 2 * ( rings - 1 ) * segments );
+    for( unsigned int r = 0 ; r + 1 < rings ; r++ ){
+        for( unsigned int s = 0 ; s < segments ; s++ ){
+            unsigned int v0 = r * segments + s, v1 = r * segments + ( s + 1 ) % segments;
+            mesh.triangles.push_back( Triangle( v0, v1, v1 + segments ) );
+            mesh.triangles.push_back( Triangle( v0, v1 + segments, v0 + segments ) );
+        }
+    }
+
+    // the top ring goes where a uniformly bent tube would put it : rotated
+    // by a quarter turn around x, on the arc of length height
+    const float angle = M_PI / 2.f;
+    const float arcRadius = height / angle;
+    const Vec3Df topCenter( 0.f, arcRadius * ( 1.f - cos( angle ) ), arcRadius * sin( angle ) );
+
+    mesh.positions = mesh.vertices;
+    mesh.handles.assign( mesh.vertices.size(), false );
+    for( unsigned int s = 0 ; s < segments ; s++ ){
+        mesh.setHandle( s, mesh.vertices[s] );
+
+        const Vec3Df & p = mesh.vertices[( rings - 1 ) * segments + s];
+        Vec3Df bent( p[0], p[1] * cos( angle ), p[1] * sin( angle ) );
+        mesh.setHandle( ( rings - 1 ) * segments + s, topCenter + bent );
+    }
+}
+
+struct HandleChangeTiming
+{
+    bool updated;
+    double updateMs;
+    double refactorMs;
+    double updatedDeformMs;
+    double refactoredDeformMs;
+};
+
+// changeNb free vertices, spread over the mesh, become handles at their rest
+// position : applied by low-rank updates of the factorization of the mesh
+// handles, then by a full factorization (the factor cache is disabled)
+static HandleChangeTiming timeHandleChanges( AsRigidAsPossible & arap, const BenchmarkMesh & mesh, unsigned int changeNb ){
+    const unsigned int n = mesh.vertices.size();
+    std::vector<bool> changed = mesh.handles;
+    const unsigned int stride = std::max( 1u, n / ( changeNb + 1 ) );
+    unsigned int added = 0;
+    for( unsigned int i = stride / 2 ; i < n && added < changeNb ; i += stride ){
+        unsigned int j = i;
+        while( j < n && changed[j] ) j++;
+        if( j < n ){
+            changed[j] = true;
+            added++;
+        }
+    }
+
+    const unsigned int threshold = arap.getUpdateThreshold();
+    const size_t budget = arap.getFactorCacheBudget();
+    arap.setFactorCacheBudget( 0 );
+
+    HandleChangeTiming timing;
+    std::chrono::steady_clock::time_point start;
+    std::vector<Vec3Df> positions;
+
+    arap.setUpdateThreshold( 0 );
+    start = std::chrono::steady_clock::now();
+    arap.setHandles( changed );
+    timing.refactorMs = elapsedMs( start );
+    positions = mesh.positions;
+    start = std::chrono::steady_clock::now();
+    arap.compute_deformation( positions );
+    timing.refactoredDeformMs = elapsedMs( start );
+    arap.setHandles( mesh.handles );
+
+    arap.setUpdateThreshold( std::max( changeNb, 1u ) );
+    unsigned int updates = arap.getStats().factorUpdates;
+    start = std::chrono::steady_clock::now();
+    arap.setHandles( changed );
+    timing.updateMs = elapsedMs( start );
+    timing.updated = arap.getStats().factorUpdates > updates;
+    positions = mesh.positions;
+    start = std::chrono::steady_clock::now();
+    arap.compute_deformation( positions );
+    timing.updatedDeformMs = elapsedMs( start );
+
+    arap.setUpdateThreshold( 0 );
+    arap.setHandles( mesh.handles );
+    arap.setUpdateThreshold( threshold );
+    arap.setFactorCacheBudget( budget );
+    return timing;
+}
+
+// The handles are dragged from their rest positions to the mesh positions in
+// frameNb deformations, counting the heap allocations : the solver workspaces
+// were allocated by the previous deformations
+static size_t countAllocations( AsRigidAsPossible & arap, const BenchmarkMesh & mesh ){
+    const unsigned int frameNb = 10;
+    std::vector<Vec3Df> positions = mesh.vertices;
+
+    allocationNb = 0;
+    allocationCounting = true;
+    for( unsigned int f = 1 ; f <= frameNb ; f++ ){
+        const float t = float( f ) / frameNb;
+        for( unsigned int i = 0 ; i < positions.size() ; i++ )
+            if( mesh.handles[i] )
+                positions[i] = mesh.vertices[i] + t * ( mesh.positions[i] - mesh.vertices[i] );
+        arap.compute_deformation( positions );
+    }
+    allocationCounting = false;
+    return allocationNb;
+}
+
+// The handles are dragged from their rest positions to the mesh positions in
+// frameNb frames deformed at once by compute_deformations on threadNb
+// threads, and frame by frame by compute_deformation on one solver per run
+// of frames, each continuing the previous frame of its run as the runs of
+// compute_deformations do. configure sets both up as the benchmarked solver.
+// Returns the largest distance between the positions of the two.
+static double checkBatch( const BenchmarkMesh & mesh, unsigned int frameNb, unsigned int threadNb,
+                          const std::function<void( AsRigidAsPossible & )> & configure ){
+    std::vector< std::vector<Vec3Df> > frames( frameNb, mesh.vertices );
+    for( unsigned int f = 0 ; f < frameNb ; f++ ){
+        const float t = float( f + 1 ) / frameNb;
+        for( unsigned int i = 0 ; i < mesh.vertices.size() ; i++ )
+            if( mesh.handles[i] )
+                frames[f][i] = mesh.vertices[i] + t * ( mesh.positions[i] - mesh.vertices[i] );
+    }
+
+    std::vector< std::vector<Vec3Df> > batch = frames;
+    AsRigidAsPossible arap;
+    configure( arap );
+    arap.setThreadNb( threadNb );
+    arap.init( mesh.vertices, mesh.triangles );
+    if( !arap.setHandles( mesh.handles ) )
+        return std::numeric_limits<double>::infinity();
+    arap.compute_deformations( batch );
+
+    // compute_deformations solves a single run on its own threads and
+    // several runs on one thread each
+    const unsigned int runNb = std::min( threadNb, frameNb );
+    double difference = 0.;
+    for( unsigned int r = 0 ; r < runNb ; r++ ){
+        AsRigidAsPossible sequential;
+        configure( sequential );
+        sequential.setThreadNb( runNb > 1 ? 1 : threadNb );
+        sequential.init( mesh.vertices, mesh.triangles );
+        if( !sequential.setHandles( mesh.handles ) )
+            return std::numeric_limits<double>::infinity();
+
+        const unsigned int begin = ( r * frameNb ) / runNb, end = ( ( r + 1 ) * frameNb ) / runNb;
+        std::vector<Vec3Df> positions;
+        for( unsigned int f = begin ; f < end ; f++ ){
+            if( f == begin )
+                positions = frames[f];
+            else
+                for( unsigned int i = 0 ; i < positions.size() ; i++ )
+                    if( mesh.handles[i] ) positions[i] = frames[f][i];
+            sequential.compute_deformation( positions );
+            for( unsigned int i = 0 ; i < positions.size() ; i++ )
+                difference = std::max( difference, double( ( positions[i] - batch[f][i] ).getLength() ) );
+        }
+    }
+    return difference;
+}
+
+// Rotation closest to S by the GSL SVD, as the local step computed it before
+// RotationFitting : R = V diag(1, 1, sign(det(V U^T))) U^T
+static void gslClosestRotation( const double * S , double * R ){
+    gsl_matrix * U = gsl_matrix_alloc( 3, 3 ), * V = gsl_matrix_alloc( 3, 3 );
+    gsl_matrix * C = gsl_matrix_alloc( 3, 3 ), * T = gsl_matrix_alloc( 3, 3 ), * M = gsl_matrix_alloc( 3, 3 );
+    gsl_vector * s = gsl_vector_alloc( 3 ), * work = gsl_vector_alloc( 3 );
+
+    for( int k = 0 ; k < 9 ; k++ )
+        gsl_matrix_set( U, k/3, k%3, S[k] );
+    gsl_linalg_SV_decomp( U, V, s, work );
+
+    gsl_blas_dgemm( CblasNoTrans, CblasTrans, 1.0, V, U, 0.0, C );
+    double det = gsl_matrix_get( C, 0, 0 ) * ( gsl_matrix_get( C, 1, 1 ) * gsl_matrix_get( C, 2, 2 ) - gsl_matrix_get( C, 2, 1 ) * gsl_matrix_get( C, 1, 2 ) )
+            + gsl_matrix_get( C, 0, 1 ) * ( gsl_matrix_get( C, 2, 0 ) * gsl_matrix_get( C, 1, 2 ) - gsl_matrix_get( C, 1, 0 ) * gsl_matrix_get( C, 2, 2 ) )
+            + gsl_matrix_get( C, 0, 2 ) * ( gsl_matrix_get( C, 1, 0 ) * gsl_matrix_get( C, 2, 1 ) - gsl_matrix_get( C, 2, 0 ) * gsl_matrix_get( C, 1, 1 ) );
+    gsl_matrix_set_identity( C );
+    gsl_matrix_set( C, 2, 2, det < 0. ? -1. : 1. );
+    gsl_blas_dgemm( CblasNoTrans, CblasTrans, 1.0, C, U, 0.0, T );
+    gsl_blas_dgemm( CblasNoTrans, CblasNoTrans, 1.0, V, T, 0.0, M );
+
+    for( int k = 0 ; k < 9 ; k++ )
+        R[k] = gsl_matrix_get( M, k/3, k%3 );
+
+    gsl_matrix_free( U ); gsl_matrix_free( V );
+    gsl_matrix_free( C ); gsl_matrix_free( T ); gsl_matrix_free( M );
+    gsl_vector_free( s ); gsl_vector_free( work );
+}
+
+static void randomRotation( std::mt19937 & random , double * Q ){
+    std::normal_distribution<double> normal;
+    double w = normal( random ), x = normal( random ), y = normal( random ), z = normal( random );
+    double norm = sqrt( w*w + x*x + y*y + z*z );
+    w /= norm; x /= norm; y /= norm; z /= norm;
+    Q[0] = 1 - 2*(y*y + z*z); Q[1] = 2*(x*y - w*z);     Q[2] = 2*(x*z + w*y);
+    Q[3] = 2*(x*y + w*z);     Q[4] = 1 - 2*(x*x + z*z); Q[5] = 2*(y*z - w*x);
+    Q[6] = 2*(x*z - w*y);     Q[7] = 2*(y*z + w*x);     Q[8] = 1 - 2*(x*x + y*y);
+}
+
+// Covariances of each kind checked by --check-rotations
+static const char * covarianceKinds[] = { "generic", "reflected", "near-rigid", "planar", "collinear", "zero" };
+
+// Covariance S = Q1 diag(d) Q2 of the given kind, with Q1 and Q2 random
+// rotations. trace(R S) is at most the sum of the |d| over the rotations R,
+// minus twice the smallest |d| when det(S) < 0 : the maximum is returned in
+// optimum. When the maximizer is unique it is written in R, it is
+// Q2^T diag(e) Q1^T with e the signs of d, the one of the smallest |d| being
+// flipped when det(S) < 0. Returns whether it is unique.
+static bool generateCovariance( const std::string & kind , std::mt19937 & random , double * S , double * R , double & optimum ){
+    std::uniform_real_distribution<double> uniform( -1., 1. );
+    double d[3] = { 1., 0.6, 0.2 };
+    bool unique = true;
+    if( kind == "reflected" )
+        d[random() % 3] *= -1.;
+    else if( kind == "near-rigid" )
+        for( int k = 0 ; k < 3 ; k++ ) d[k] = 1. + 1e-3 * uniform( random );
+    else if( kind == "planar" )
+        d[2] = 0.;
+    else if( kind == "collinear" || kind == "zero" ){
+        d[1] = d[2] = 0.;
+        if( kind == "zero" ) d[0] = 0.;
+        unique = false;
+    }
+    std::swap( d[random() % 3], d[2] );
+
+    // from 1e-3 to 1e3, the scale of the one-ring does not matter
+    const double scale = pow( 10., 3. * uniform( random ) );
+    int smallest = 0;
+    for( int k = 0 ; k < 3 ; k++ ){
+        d[k] *= scale;
+        if( fabs( d[k] ) < fabs( d[smallest] ) ) smallest = k;
+    }
+
+    double e[3];
+    optimum = 0.;
+    for( int k = 0 ; k < 3 ; k++ ){
+        e[k] = d[k] < 0. ? -1. : 1.;
+        optimum += fabs( d[k] );
+    }
+    if( d[0] * d[1] * d[2] < 0. ){
+        e[smallest] = -e[smallest];
+        optimum -= 2. * fabs( d[smallest] );
+    }
+
+    double Q1[9], Q2[9];
+    randomRotation( random, Q1 );
+    randomRotation( random, Q2 );
+    for( int r = 0 ; r < 3 ; r++ )
+        for( int c = 0 ; c < 3 ; c++ ){
+            S[3*r + c] = R[3*r + c] = 0.;
+            for( int k = 0 ; k < 3 ; k++ ){
+                S[3*r + c] += Q1[3*r + k] * d[k] * Q2[3*k + c];
+                R[3*r + c] += Q2[3*k + r] * e[k] * Q1[3*c + k];
+            }
+        }
+    return unique;
+}
+
+struct RotationErrors
+{
+    double rotation;      // largest coefficient difference with the unique maximizer
+    double objective;     // shortfall of trace(R S) from its maximum, relative to |S|
+    double orthonormality; // largest coefficient of R R^T - I, and |det(R) - 1|
+
+    RotationErrors() : rotation( 0. ), objective( 0. ), orthonormality( 0. ) {}
+
+    void add( const double * S , const double * expected , bool unique , double optimum , const double * R ){
+        double trace = 0., norm = 0.;
+        for( int k = 0 ; k < 9 ; k++ ){
+            if( unique ) rotation = std::max( rotation, fabs( R[k] - expected[k] ) );
+            trace += R[k] * S[3*(k%3) + k/3];
+            norm += S[k] * S[k];
+        }
+        if( norm > 0. )
+            objective = std::max( objective, ( optimum - trace ) / sqrt( norm ) );
+
+        for( int r = 0 ; r < 3 ; r++ )
+            for( int c = 0 ; c < 3 ; c++ ){
+                double p = R[3*r] * R[3*c] + R[3*r + 1] * R[3*c + 1] + R[3*r + 2] * R[3*c + 2];
+                orthonormality = std::max( orthonormality, fabs( p - ( r == c ? 1. : 0. ) ) );
+            }
+        double det = R[0] * ( R[4] * R[8] - R[7] * R[5] ) + R[1] * ( R[6] * R[5] - R[3] * R[8] ) + R[2] * ( R[3] * R[7] - R[6] * R[4] );
+        orthonormality = std::max( orthonormality, fabs( det - 1. ) );
+    }
+
+    bool within( double tolerance ) const {
+        return rotation <= tolerance && objective <= tolerance && orthonormality <= tolerance;
+    }
+};
+
+static std::ostream & operator<<( std::ostream & out , const RotationErrors & errors ){
+    return out << "{\"rotation\": " << errors.rotation << ", \"objective\": " << errors.objective
+               << ", \"orthonormality\": " << errors.orthonormality << "}";
+}
+
+// Checks the rotation fitting of the local step (RotationFitting.h) on count
+// covariances of each kind against their exact closest rotations, next to the
+// GSL SVD it replaced, and times the three of them per vertex. Returns false
+// when the double or the batched float kernel is not within its tolerance.
+static bool checkRotations( unsigned int count ){
+    const double tolerance = 1e-9, batchedTolerance = 1e-4;
+    std::mt19937 random( 1 );
+    bool passed = true;
+
+    for( unsigned int t = 0 ; t < sizeof( covarianceKinds ) / sizeof( covarianceKinds[0] ) ; t++ ){
+        std::vector<double> S( 9 * count ), expected( 9 * count ), optimum( count );
+        std::vector<bool> unique( count );
+        for( unsigned int i = 0 ; i < count ; i++ )
+            unique[i] = generateCovariance( covarianceKinds[t], random, &S[9*i], &expected[9*i], optimum[i] );
+
+        std::vector<double> gslR( 9 * count ), R( 9 * count );
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for( unsigned int i = 0 ; i < count ; i++ )
+            gslClosestRotation( &S[9*i], &gslR[9*i] );
+        double gslMs = elapsedMs( start );
+
+        start = std::chrono::steady_clock::now();
+        for( unsigned int i = 0 ; i < count ; i++ )
+            RotationFitting::closestRotation( &S[9*i], &R[9*i] );
+        double scalarMs = elapsedMs( start );
+
+        // the local step layout : coefficient k of vertex i at k * count + i
+        std::vector<float> batchedS( 9 * count ), batchedR( 9 * count );
+        for( unsigned int i = 0 ; i < count ; i++ )
+            for( int k = 0 ; k < 9 ; k++ )
+                batchedS[k*count + i] = S[9*i + k];
+        start = std::chrono::steady_clock::now();
+        RotationFitting::closestRotations( &batchedS[0], &batchedR[0], count, count );
+        double batchedMs = elapsedMs( start );
+
+        RotationErrors gslErrors, errors, batchedErrors;
+        for( unsigned int i = 0 ; i < count ; i++ ){
+            double batched[9];
+            for( int k = 0 ; k < 9 ; k++ )
+                batched[k] = batchedR[k*count + i];
+            gslErrors.add( &S[9*i], &expected[9*i], unique[i], optimum[i], &gslR[9*i] );
+            errors.add( &S[9*i], &expected[9*i], unique[i], optimum[i], &R[9*i] );
+            batchedErrors.add( &S[9*i], &expected[9*i], unique[i], optimum[i], batched );
+        }
+        bool kindPassed = errors.within( tolerance ) && batchedErrors.within( batchedTolerance );
+        passed = passed && kindPassed;
+
+        std::cout << "{\"revision\": \"" << ARAP_REVISION << "\""
+                  << ", \"covariances\": \"" << covarianceKinds[t] << "\""
+                  << ", \"count\": " << count
+                  << ", \"instruction_set\": \"" << RotationFitting::instructionSet() << "\""
+                  << ", \"gsl_errors\": " << gslErrors
+                  << ", \"errors\": " << errors
+                  << ", \"batched_errors\": " << batchedErrors
+                  << ", \"passed\": " << ( kindPassed ? "true" : "false" )
+                  << ", \"gsl_ns\": " << gslMs * 1e6 / count
+                  << ", \"scalar_ns\": " << scalarMs * 1e6 / count
+                  << ", \"batched_ns\": " << batchedMs * 1e6 / count
+                  << "}" << std::endl;
+    }
+    return passed;
+}
+
+// Cylinder of about size vertices and one more vertex that no triangle
+// references, whose row of the system is empty : deformed with the
+// conjugate gradient, each preconditioner in each constraint mode. Returns
+// false when setHandles fails or a deformed position is not finite.
+static bool checkPreconditioners( unsigned int size ){
+    BenchmarkMesh mesh;
+    generateCylinder( size, mesh );
+    mesh.vertices.push_back( Vec3Df( 0.f, 0.f, 2.f ) );
+    mesh.positions.push_back( mesh.vertices.back() );
+    mesh.handles.push_back( false );
+
+    bool passed = true;
+    for( int hard = 0 ; hard < 2 ; hard++ ){
+        for( int ic = 0 ; ic < 2 ; ic++ ){
+            AsRigidAsPossible arap;
+            arap.setLinearSolver( AsRigidAsPossible::CONJUGATE_GRADIENT );
+            arap.setConjugateGradientPreconditioner( ic ? AsRigidAsPossible::INCOMPLETE_CHOLESKY : AsRigidAsPossible::JACOBI );
+            if( hard )
+                arap.setConstraintMode( AsRigidAsPossible::HARD );
+            arap.init( mesh.vertices, mesh.triangles );
+
+            bool handlesSet = arap.setHandles( mesh.handles );
+            bool finite = handlesSet;
+            std::vector<Vec3Df> positions = mesh.positions;
+            if( handlesSet ){
+                arap.compute_deformation( positions );
+                for( unsigned int i = 0 ; i < positions.size() ; i++ )
+                    for( int k = 0 ; k < 3 ; k++ )
+                        finite = finite && std::isfinite( positions[i][k] );
+            }
+            passed = passed && finite;
+
+            std::cout << "{\"revision\": \"" << ARAP_REVISION << "\""
+                      << ", \"shape\": \"cylinder\""
+                      << ", \"vertices\": " << mesh.vertices.size()
+                      << ", \"unreferenced\": 1"
+                      << ", \"constraints\": \"" << ( hard ? "hard" : "soft" ) << "\""
+                      << ", \"preconditioner\": \"" << ( ic ? "ic" : "jacobi" ) << "\""
+                      << ", \"set_handles\": " << ( handlesSet ? "true" : "false" )
+                      << ", \"finite\": " << ( finite ? "true" : "false" )
+                      << ", \"cg_iterations\": " << arap.getConjugateGradientIterations()
+                      << ", \"factor_bytes\": " << arap.getStats().factorBytes
+                      << "}" << std::endl;
+        }
+    }
+    return passed;
+}
+
+// names of the AsRigidAsPossible::Factorization and Ordering values
+static const char * factorizationNames[] = { "auto", "simplicial", "supernodal" };
+static const char * orderingNames[] = { "auto", "amd", "metis", "nesdis" };
+
+static int findName( const char * const * names , unsigned int nameNb , const std::string & name ){
+    for( unsigned int i = 0 ; i < nameNb ; i++ )
+        if( name == names[i] )
+            return i;
+    return -1;
+}
+
+static const char * cholmodOrderingName( int ordering ){
+    switch( ordering ){
+    case CHOLMOD_NATURAL : return "natural";
+    case CHOLMOD_GIVEN : return "given";
+    case CHOLMOD_AMD : return "amd";
+    case CHOLMOD_METIS : return "metis";
+    case CHOLMOD_NESDIS : return "nesdis";
+    case CHOLMOD_COLAMD : return "colamd";
+    default : return "none";
+    }
+}
+
+static std::vector<std::string> splitList( const char * list ){
+    std::vector<std::string> items;
+    std::stringstream stream( list );
+    std::string item;
+    while( std::getline( stream, item, ',' ) )
+        if( !item.empty() )
+            items.push_back( item );
+    return items;
+}
+
+static void usage(){
+    std::cout << "usage : arapBenchmark [--shapes sphere,grid,cylinder] [--sizes 10000,100000,1000000]"
+              << " [--threads 1,2,...] [--iterations N] [--hard] [--solver cholesky|cg] [--preconditioner jacobi|ic] [--levels N] [--anderson 0,5,...] [--cluster-size 1,4,...] [--tolerance t] [--check-allocations] [--check-batch N] [--check-rotations N] [--check-preconditioners N]"
+              << " [--factorization auto,simplicial,supernodal] [--ordering auto,amd,metis,nesdis] [--table]"
+              << " [--handle-changes 1,10,...]" << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    std::vector<std::string> shapes;
+    shapes.push_back( "sphere" );
+    shapes.push_back( "grid" );
+    shapes.push_back( "cylinder" );
+
+    std::vector<unsigned int> sizes;
+    sizes.push_back( 10000 );
+    sizes.push_back( 100000 );
+    sizes.push_back( 1000000 );
+
+    std::vector<unsigned int> threads;
+#ifdef _OPENMP
+    threads.push_back( omp_get_num_procs() );
+#else
+    threads.push_back( 1 );
+#endif
+
+    unsigned int iterationNb = 5;
+    unsigned int levelNb = 1;
+    std::vector<unsigned int> andersonWindows( 1, 0 );
+    std::vector<unsigned int> clusterSizes( 1, 1 );
+    double tolerance = 0.;
+    bool hard = false;
+    bool cg = false;
+    AsRigidAsPossible::Preconditioner preconditioner = AsRigidAsPossible::JACOBI;
+    bool checkAllocations = false;
+    bool failed = false;
+    std::vector<unsigned int> factorizations( 1, AsRigidAsPossible::FACTORIZATION_AUTO );
+    std::vector<unsigned int> orderings( 1, AsRigidAsPossible::ORDERING_AUTO );
+    bool table = false;
+    std::vector<unsigned int> handleChanges;
+    unsigned int rotationCheckNb = 0;
+    unsigned int preconditionerCheckSize = 0;
+    unsigned int batchFrameNb = 0;
+
+    for( int a = 1 ; a < argc ; a++ ){
+        bool hasValue = a + 1 < argc;
+        if( !strcmp( argv[a], "--hard" ) )
+            hard = true;
+        else if( !strcmp( argv[a], "--cg" ) )
+            cg = true;
+        else if( !strcmp( argv[a], "--solver" ) && hasValue )
+            cg = !strcmp( argv[++a], "cg" );
+        else if( !strcmp( argv[a], "--preconditioner" ) && hasValue ){
+            preconditioner = !strcmp( argv[++a], "ic" ) ? AsRigidAsPossible::INCOMPLETE_CHOLESKY
+                                                       : AsRigidAsPossible::JACOBI;
+        }
+        else if( !strcmp( argv[a], "--check-allocations" ) )
+            checkAllocations = true;
+        else if( !strcmp( argv[a], "--shapes" ) && hasValue )
+            shapes = splitList( argv[++a] );
+        else if( !strcmp( argv[a], "--sizes" ) && hasValue ){
+            std::vector<std::string> items = splitList( argv[++a] );
+            sizes.clear();
+            for( unsigned int i = 0 ; i < items.size() ; i++ )
+                sizes.push_back( atoi( items[i].c_str() ) );
+        }
+        else if( !strcmp( argv[a], "--threads" ) && hasValue ){
+            std::vector<std::string> items = splitList( argv[++a] );
+            threads.clear();
+            for( unsigned int i = 0 ; i < items.size() ; i++ )
+                threads.push_back( atoi( items[i].c_str() ) );
+        }
+        else if( !strcmp( argv[a], "--anderson" ) && hasValue ){
+            std::vector<std::string> items = splitList( argv[++a] );
+            andersonWindows.clear();
+            for( unsigned int i = 0 ; i < items.size() ; i++ )
+                andersonWindows.push_back( atoi( items[i].c_str() ) );
+        }
+        else if( !strcmp( argv[a], "--cluster-size" ) && hasValue ){
+            std::vector<std::string> items = splitList( argv[++a] );
+            clusterSizes.clear();
+            for( unsigned int i = 0 ; i < items.size() ; i++ )
+                clusterSizes.push_back( atoi( items[i].c_str() ) );
+        }
+        else if( !strcmp( argv[a], "--tolerance" ) && hasValue )
+            tolerance = atof( argv[++a] );
+        else if( !strcmp( argv[a], "--handle-changes" ) && hasValue ){
+            std::vector<std::string> items = splitList( argv[++a] );
+            for( unsigned int i = 0 ; i < items.size() ; i++ )
+                handleChanges.push_back( atoi( items[i].c_str() ) );
+        }
+        else if( !strcmp( argv[a], "--check-rotations" ) && hasValue )
+            rotationCheckNb = atoi( argv[++a] );
+        else if( !strcmp( argv[a], "--check-batch" ) && hasValue )
+            batchFrameNb = atoi( argv[++a] );
+        else if( !strcmp( argv[a], "--check-preconditioners" ) && hasValue )
+            preconditionerCheckSize = atoi( argv[++a] );
+        else if( !strcmp( argv[a], "--iterations" ) && hasValue )
+            iterationNb = atoi( argv[++a] );
+        else if( !strcmp( argv[a], "--levels" ) && hasValue )
+            levelNb = atoi( argv[++a] );
+        else if( ( !strcmp( argv[a], "--factorization" ) || !strcmp( argv[a], "--ordering" ) ) && hasValue ){
+            bool isFactorization = !strcmp( argv[a], "--factorization" );
+            std::vector<unsigned int> & values = isFactorization ? factorizations : orderings;
+            std::vector<std::string> items = splitList( argv[++a] );
+            values.clear();
+            for( unsigned int i = 0 ; i < items.size() ; i++ ){
+                int value = isFactorization ? findName( factorizationNames, 3, items[i] ) : findName( orderingNames, 4, items[i] );
+                if( value < 0 ){
+                    std::cout << "unknown " << ( isFactorization ? "factorization " : "ordering " ) << items[i] << std::endl;
+                    usage();
+                    return EXIT_FAILURE;
+                }
+                values.push_back( value );
+            }
+        }
+        else if( !strcmp( argv[a], "--table" ) )
+            table = true;
+        else {
+            std::cout << "unknown option " << argv[a] << std::endl;
+            usage();
+            return EXIT_FAILURE;
+        }
+    }
+
+    if( rotationCheckNb > 0 )
+        return checkRotations( rotationCheckNb ) ? EXIT_SUCCESS : EXIT_FAILURE;
+    if( preconditionerCheckSize > 0 )
+        return checkPreconditioners( preconditionerCheckSize ) ? EXIT_SUCCESS : EXIT_FAILURE;
+
+    if( table )
+        std::cout << std::left << std::setw( 10 ) << "shape" << std::right << std::setw( 10 ) << "vertices"
+                  << std::setw( 8 ) << "threads" << std::setw( 12 ) << "solver" << std::setw( 14 ) << "factorization"
+                  << std::setw( 10 ) << "ordering" << std::setw( 8 ) << "used" << std::setw( 12 ) << "supernodal"
+                  << std::setw( 12 ) << "analyze_ms" << std::setw( 14 ) << "factorize_ms" << std::setw( 10 ) << "solve_ms"
+                  << std::setw( 12 ) << "nnz_l" << std::setw( 12 ) << "factor_mb" << std::endl;
+
+    for( unsigned int s = 0 ; s < shapes.size() ; s++ ){
+        for( unsigned int z = 0 ; z < sizes.size() ; z++ ){
+
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            BenchmarkMesh mesh;
+            if( shapes[s] == "sphere" )
+                generateSphere( sizes[z], mesh );
+            else if( shapes[s] == "grid" )
+                generateGrid( sizes[z], mesh );
+            else if( shapes[s] == "cylinder" )
+                generateCylinder( sizes[z], mesh );
+            else {
+                std::cout << "unknown shape " << shapes[s] << std::endl;
+                usage();
+                return EXIT_FAILURE;
+            }
+            double generateMs = elapsedMs( start );
+
+            unsigned int handleNb = 0;
+            for( unsigned int i = 0 ; i < mesh.handles.size() ; i++ )
+                if( mesh.handles[i] ) handleNb++;
+
+            const unsigned int runNb = threads.size() * andersonWindows.size() * clusterSizes.size() * factorizations.size() * orderings.size();
+            for( unsigned int run = 0 ; run < runNb ; run++ ){
+                unsigned int index = run;
+                const unsigned int o = index % orderings.size(); index /= orderings.size();
+                const unsigned int f = index % factorizations.size(); index /= factorizations.size();
+                const unsigned int r = index % clusterSizes.size(); index /= clusterSizes.size();
+                const unsigned int w = index % andersonWindows.size(); index /= andersonWindows.size();
+                const unsigned int t = index;
+                const char * factorizationName = factorizationNames[factorizations[f]];
+                const char * orderingName = orderingNames[orderings[o]];
+                auto configure = [&]( AsRigidAsPossible & solver ){
+                    solver.setIterationNb( iterationNb );
+                    solver.setTolerance( tolerance );
+                    solver.setAndersonWindow( andersonWindows[w] );
+                    solver.setRotationClusterSize( clusterSizes[r] );
+                    solver.setLevelNb( levelNb );
+                    solver.setFactorization( AsRigidAsPossible::Factorization( factorizations[f] ) );
+                    solver.setOrdering( AsRigidAsPossible::Ordering( orderings[o] ) );
+                    if( hard )
+                        solver.setConstraintMode( AsRigidAsPossible::HARD );
+                    if( cg )
+                        solver.setLinearSolver( AsRigidAsPossible::CONJUGATE_GRADIENT );
+                    solver.setConjugateGradientPreconditioner( preconditioner );
+                };
+                AsRigidAsPossible arap;
+                arap.setThreadNb( threads[t] );
+                configure( arap );
+
+                start = std::chrono::steady_clock::now();
+                arap.init( mesh.vertices, mesh.triangles );
+                double initMs = elapsedMs( start );
+
+                start = std::chrono::steady_clock::now();
+                if( !arap.setHandles( mesh.handles ) )
+                    return EXIT_FAILURE;
+                double setHandlesMs = elapsedMs( start );
+
+                std::vector<Vec3Df> positions = mesh.positions;
+                start = std::chrono::steady_clock::now();
+                arap.compute_deformation( positions );
+                double deformMs = elapsedMs( start );
+                const AsRigidAsPossible::Stats & stats = arap.getStats();
+
+                if( table )
+                    std::cout << std::left << std::setw( 10 ) << shapes[s] << std::right << std::setw( 10 ) << mesh.vertices.size()
+                              << std::setw( 8 ) << arap.getThreadNb() << std::setw( 12 ) << ( cg ? "cg" : "cholesky" )
+                              << std::setw( 14 ) << factorizationName << std::setw( 10 ) << orderingName
+                              << std::setw( 8 ) << cholmodOrderingName( stats.factorOrdering )
+                              << std::setw( 12 ) << ( stats.supernodalFactor ? "yes" : "no" )
+                              << std::fixed << std::setprecision( 1 )
+                              << std::setw( 12 ) << stats.analyze.total << std::setw( 14 ) << stats.factorize.total
+                              << std::setw( 10 ) << stats.solve.mean() << std::setw( 12 ) << stats.nnzL
+                              << std::setw( 12 ) << stats.factorBytes / 1048576. << std::defaultfloat << std::endl;
+                else {
+                    std::cout << "{\"revision\": \"" << ARAP_REVISION << "\""
+                              << ", \"shape\": \"" << shapes[s] << "\""
+                              << ", \"vertices\": " << mesh.vertices.size()
+                              << ", \"triangles\": " << mesh.triangles.size()
+                              << ", \"handles\": " << handleNb
+                              << ", \"threads\": " << arap.getThreadNb()
+                              << ", \"constraints\": \"" << ( hard ? "hard" : "soft" ) << "\""
+                              << ", \"solver\": \"" << ( cg ? "cg" : "cholesky" ) << "\""
+                              << ", \"preconditioner\": \"" << ( preconditioner == AsRigidAsPossible::INCOMPLETE_CHOLESKY ? "ic" : "jacobi" ) << "\""
+                              << ", \"factorization\": \"" << factorizationName << "\""
+                              << ", \"ordering\": \"" << orderingName << "\""
+                              << ", \"levels\": " << arap.getLevelNb()
+                              << ", \"anderson\": " << arap.getAndersonWindow()
+                              << ", \"cluster_size\": " << arap.getRotationClusterSize()
+                              << ", \"rotation_clusters\": " << arap.getRotationClusterNb()
+                              << ", \"tolerance\": " << arap.getTolerance()
+                              << ", \"generate_ms\": " << generateMs
+                              << ", \"init_ms\": " << initMs
+                              << ", \"adjacency_ms\": " << stats.adjacency.total
+                              << ", \"set_handles_ms\": " << setHandlesMs
+                              << ", \"analyze_ms\": " << stats.analyze.total
+                              << ", \"factorize_ms\": " << stats.factorize.total
+                              << ", \"deform_ms\": " << deformMs
+                              << ", \"rhs_ms\": " << stats.rhs.mean()
+                              << ", \"solve_ms\": " << stats.solve.mean()
+                              << ", \"rotations_ms\": " << stats.localStep.mean()
+                              << ", \"iterations\": " << arap.getIterationsUsed()
+                              << ", \"energy\": " << arap.getEnergy()
+                              << ", \"nnz_a\": " << stats.nnzA
+                              << ", \"nnz_l\": " << stats.nnzL
+                              << ", \"factor_bytes\": " << stats.factorBytes
+                              << ", \"factor_ordering\": \"" << cholmodOrderingName( stats.factorOrdering ) << "\""
+                              << ", \"supernodal\": " << ( stats.supernodalFactor ? "true" : "false" )
+                              << ", \"cg_iterations\": " << arap.getConjugateGradientIterations()
+                              << ", \"peak_rss_kb\": " << peakResidentKb()
+                              << "}" << std::endl;
+                }
+
+                if( checkAllocations ){
+                    size_t allocations = countAllocations( arap, mesh );
+                    failed = failed || allocations > 0;
+                    std::cout << "{\"revision\": \"" << ARAP_REVISION << "\""
+                              << ", \"shape\": \"" << shapes[s] << "\""
+                              << ", \"vertices\": " << mesh.vertices.size()
+                              << ", \"threads\": " << arap.getThreadNb()
+                              << ", \"constraints\": \"" << ( hard ? "hard" : "soft" ) << "\""
+                              << ", \"solver\": \"" << ( cg ? "cg" : "cholesky" ) << "\""
+                              << ", \"levels\": " << arap.getLevelNb()
+                              << ", \"allocations\": " << allocations
+                              << "}" << std::endl;
+                }
+
+                if( batchFrameNb > 0 ){
+                    double difference = checkBatch( mesh, batchFrameNb, arap.getThreadNb(), configure );
+                    bool matched = difference <= 1e-6;
+                    failed = failed || !matched;
+                    std::cout << "{\"revision\": \"" << ARAP_REVISION << "\""
+                              << ", \"shape\": \"" << shapes[s] << "\""
+                              << ", \"vertices\": " << mesh.vertices.size()
+                              << ", \"threads\": " << arap.getThreadNb()
+                              << ", \"constraints\": \"" << ( hard ? "hard" : "soft" ) << "\""
+                              << ", \"solver\": \"" << ( cg ? "cg" : "cholesky" ) << "\""
+                              << ", \"levels\": " << arap.getLevelNb()
+                              << ", \"frames\": " << batchFrameNb
+                              << ", \"batch_difference\": " << difference
+                              << ", \"matched\": " << ( matched ? "true" : "false" )
+                              << "}" << std::endl;
+                }
+
+                for( unsigned int c = 0 ; c < handleChanges.size() && !cg ; c++ ){
+                    HandleChangeTiming timing = timeHandleChanges( arap, mesh, handleChanges[c] );
+                    std::cout << "{\"revision\": \"" << ARAP_REVISION << "\""
+                              << ", \"shape\": \"" << shapes[s] << "\""
+                              << ", \"vertices\": " << mesh.vertices.size()
+                              << ", \"handles\": " << handleNb
+                              << ", \"threads\": " << arap.getThreadNb()
+                              << ", \"constraints\": \"" << ( hard ? "hard" : "soft" ) << "\""
+                              << ", \"factorization\": \"" << factorizationName << "\""
+                              << ", \"ordering\": \"" << orderingName << "\""
+                              << ", \"handle_changes\": " << handleChanges[c]
+                              << ", \"updated\": " << ( timing.updated ? "true" : "false" )
+                              << ", \"update_ms\": " << timing.updateMs
+                              << ", \"refactor_ms\": " << timing.refactorMs
+                              << ", \"deform_updated_ms\": " << timing.updatedDeformMs
+                              << ", \"deform_refactored_ms\": " << timing.refactoredDeformMs
+                              << "}" << std::endl;
+                }
+            }
+        }
+    }
+
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
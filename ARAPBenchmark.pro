@@ -0,0 +1,20 @@
+# Benchmark on generated meshes : times the solver phases and writes one
+# JSON line per run (see ARAPBenchmark.cpp for the options)
+TEMPLATE = app
+TARGET = arapBenchmark
+CONFIG += console
+CONFIG -= app_bundle \
+    qt
+
+include(ARAPCommon.pri)
+include(ARAPCore.pri)
+
+# commit the numbers were measured on, reported in the JSON lines
+ARAP_REVISION = $$system(git rev-parse --short HEAD 2>/dev/null)
+!isEmpty(ARAP_REVISION): DEFINES += ARAP_REVISION=\\\"$${ARAP_REVISION}\\\"
+
+SOURCES += ARAPBenchmark.cpp
+
+# GSL SVD reference of --check-rotations
+LIBS += -lgsl \
+    -lgslcblas
@@ -0,0 +1,26 @@
+# Settings shared by the solver library (ARAPCore.pro), the viewer
+# (ARAPViewer.pro) and the command-line tool (ARAPDeform.pro).
+# Include it after TARGET is set.
+MOC_DIR = ./moc/$${TARGET}
+OBJECTS_DIR = ./obj/$${TARGET}
+DEPENDPATH += ./include
+CONFIG -= debug \
+    debug_and_release
+CONFIG += release \
+    warn_on \
+    thread \
+    rtti \
+    c++11
+# lets the square roots of the SIMD rotation fitting vectorize (RotationFitting.cpp)
+QMAKE_CXXFLAGS += -fno-math-errno
+# parallel local step and right-hand side assembly (AsRigidAsPossible.cpp)
+QMAKE_CXXFLAGS += -fopenmp
+QMAKE_LFLAGS += -fopenmp
+# to specify with your own configuration: locate libcholmod folder (likely in the folder /usr/include #
+EXT_DIR = ../../extern
+
+INCLUDEPATH = ./Manipulator \
+    /usr/include/suitesparse
+INCLUDEPATH += $${EXT_DIR}/libcholmod/CHOLMOD/Include \
+    $${EXT_DIR}/libcholmod/UFconfig \
+    /usr/include/
@@ -0,0 +1,29 @@
+# Links the arapCore library (ARAPCore.pro) and its dependencies.
+# Include it after ARAPCommon.pri.
+LIBS += -L$${OUT_PWD} \
+    -larapCore
+PRE_TARGETDEPS += $${OUT_PWD}/libarapCore.a
+
+LIBS += -L/usr/lib/x86_64-linux-gnu \
+    -lblas \
+    -lgomp
+
+
+
+# ------------------------------ for CHOLMOD : ------------------------------#
+QMAKE_LIBDIR +=$${EXT_DIR}/libcholmod/CHOLMOD/Lib \
+    $${EXT_DIR}/libcholmod/AMD/Lib \
+    $${EXT_DIR}/libcholmod/COLAMD/Lib \
+    $${EXT_DIR}/libcholmod/CCOLAMD/Lib \
+    $${EXT_DIR}/libcholmod/CAMD/Lib
+
+LIBS += -lcholmod \
+    -lamd \
+    -lcolamd \
+    -lccolamd \
+    -lcamd \
+    -llapack \
+   # -lgfortran \
+   # -lgfortranbegin \
+   # -lgfortran \
+    -lm
@@ -0,0 +1,24 @@
+# arapCore : the ARAP solver, the mesh data structure and the mesh I/O,
+# without any Qt or OpenGL dependency. Linked by the viewer and the
+# command-line tool through ARAPCore.pri.
+TEMPLATE = lib
+TARGET = arapCore
+CONFIG += staticlib
+CONFIG -= qt
+
+include(ARAPCommon.pri)
+
+HEADERS += Vec3D.h \
+    Triangle.h \
+    Edge.h \
+    FileIO.h \
+    Mesh.h \
+    MeshAdjacency.h \
+    AsRigidAsPossible.h \
+    ARAPSolverThread.h \
+    RotationFitting.h
+SOURCES += AsRigidAsPossible.cpp \
+    ARAPSolverThread.cpp \
+    RotationFitting.cpp \
+    MeshAdjacency.cpp \
+    Mesh.cpp
@@ -0,0 +1,152 @@
+/****************************************************************************
+  Headless ARAP deformation :
+
+  arapDeform mesh.(off|obj) constraints.txt output.off [options]
+
+  The constraints file has the format read by ARAPViewer::openConstraints,
+  one "vertex_id x y z" line per handle. The other vertices start from the
+  rest pose. Options :
+    --iterations N     maximum number of ARAP iterations (5)
+    --tolerance t      stop once the energy and the positions change by less than t (0)
+    --threads N        threads of the solver (all the cores)
+    --hard             hard handle constraints
+    --levels N         multiresolution levels (1)
+    --anderson M       Anderson acceleration window (0)
+    --cg               conjugate gradient instead of the Cholesky factorization
+    --cluster-size N   vertices per rotation of the local step (1)
+
+  The last line written on the standard output is a JSON object with the
+  sizes, the timings in milliseconds and the solver report.
+*****************************************************************************/
+#include "AsRigidAsPossible.h"
+#include "FileIO.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+static double elapsedMs( const std::chrono::steady_clock::time_point & start ){
+    return std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+}
+
+static void usage(){
+    std::cout << "usage : arapDeform mesh.(off|obj) constraints.txt output.off [--iterations N] [--tolerance t]"
+              << " [--threads N] [--hard] [--levels N] [--anderson M] [--cg] [--cluster-size N]" << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    if( argc < 4 ){
+        usage();
+        return EXIT_FAILURE;
+    }
+
+    const std::string meshFile = argv[1];
+    const std::string constraintsFile = argv[2];
+    const std::string outputFile = argv[3];
+
+    AsRigidAsPossible arap;
+
+    for( int a = 4 ; a < argc ; a++ ){
+        bool hasValue = a + 1 < argc;
+        if( !strcmp( argv[a], "--hard" ) )
+            arap.setConstraintMode( AsRigidAsPossible::HARD );
+        else if( !strcmp( argv[a], "--cg" ) )
+            arap.setLinearSolver( AsRigidAsPossible::CONJUGATE_GRADIENT );
+        else if( !strcmp( argv[a], "--iterations" ) && hasValue )
+            arap.setIterationNb( atoi( argv[++a] ) );
+        else if( !strcmp( argv[a], "--tolerance" ) && hasValue )
+            arap.setTolerance( atof( argv[++a] ) );
+        else if( !strcmp( argv[a], "--threads" ) && hasValue )
+            arap.setThreadNb( atoi( argv[++a] ) );
+        else if( !strcmp( argv[a], "--levels" ) && hasValue )
+            arap.setLevelNb( atoi( argv[++a] ) );
+        else if( !strcmp( argv[a], "--anderson" ) && hasValue )
+            arap.setAndersonWindow( atoi( argv[++a] ) );
+        else if( !strcmp( argv[a], "--cluster-size" ) && hasValue )
+            arap.setRotationClusterSize( atoi( argv[++a] ) );
+        else {
+            std::cout << "unknown option " << argv[a] << std::endl;
+            usage();
+            return EXIT_FAILURE;
+        }
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    std::vector<Vec3Df> vertices;
+    std::vector<Triangle> triangles;
+    if( meshFile.size() > 4 && meshFile.substr( meshFile.size() - 4 ) == ".obj" ){
+        if( !FileIO::objLoader( meshFile, vertices, triangles ) )
+            return EXIT_FAILURE;
+    } else {
+        if( !FileIO::openOFF( meshFile, vertices, triangles ) )
+            return EXIT_FAILURE;
+    }
+    if( vertices.empty() ){
+        std::cout << meshFile << " : no vertices" << std::endl;
+        return EXIT_FAILURE;
+    }
+    for( unsigned int t = 0 ; t < triangles.size() ; t++ ){
+        for( int c = 0 ; c < 3 ; c++ ){
+            if( triangles[t].getVertex(c) >= vertices.size() ){
+                std::cout << meshFile << " : triangle " << t << " vertex id " << (int)triangles[t].getVertex(c) << " >= number of vertices" << std::endl;
+                return EXIT_FAILURE;
+            }
+        }
+    }
+
+    std::vector< std::pair<int, Vec3Df> > constraints;
+    if( !FileIO::openConstraints( constraintsFile, constraints ) )
+        return EXIT_FAILURE;
+
+    std::vector<Vec3Df> positions = vertices;
+    std::vector<bool> handles( vertices.size(), false );
+    for( unsigned int i = 0 ; i < constraints.size() ; i++ ){
+        if( constraints[i].first < 0 || (unsigned int)constraints[i].first >= vertices.size() ){
+            std::cout << constraintsFile << " : constraint id " << constraints[i].first << " > number of vertices" << std::endl;
+            return EXIT_FAILURE;
+        }
+        positions[constraints[i].first] = constraints[i].second;
+        handles[constraints[i].first] = true;
+    }
+    double loadMs = elapsedMs( start );
+
+    start = std::chrono::steady_clock::now();
+    arap.init( vertices, triangles );
+    double initMs = elapsedMs( start );
+
+    start = std::chrono::steady_clock::now();
+    if( !arap.setHandles( handles ) )
+        return EXIT_FAILURE;
+    double factorizeMs = elapsedMs( start );
+
+    start = std::chrono::steady_clock::now();
+    arap.compute_deformation( positions );
+    double deformMs = elapsedMs( start );
+
+    start = std::chrono::steady_clock::now();
+    if( !FileIO::saveOFF( outputFile, positions, triangles ) )
+        return EXIT_FAILURE;
+    double saveMs = elapsedMs( start );
+
+    std::cout << "{\"vertices\": " << vertices.size()
+              << ", \"triangles\": " << triangles.size()
+              << ", \"handles\": " << constraints.size()
+              << ", \"threads\": " << arap.getThreadNb()
+              << ", \"cluster_size\": " << arap.getRotationClusterSize()
+              << ", \"rotation_clusters\": " << arap.getRotationClusterNb()
+              << ", \"load_ms\": " << loadMs
+              << ", \"init_ms\": " << initMs
+              << ", \"factorize_ms\": " << factorizeMs
+              << ", \"deform_ms\": " << deformMs
+              << ", \"save_ms\": " << saveMs
+              << ", \"iterations\": " << arap.getIterationsUsed()
+              << ", \"energy\": " << arap.getEnergy()
+              << "}" << std::endl;
+
+    return EXIT_SUCCESS;
+}
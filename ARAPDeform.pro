@@ -0,0 +1,12 @@
+# Command-line deformation tool : runs ARAP on a mesh and a constraints file
+# without any window (see ARAPDeform.cpp for the usage)
+TEMPLATE = app
+TARGET = arapDeform
+CONFIG += console
+CONFIG -= app_bundle \
+    qt
+
+include(ARAPCommon.pri)
+include(ARAPCore.pri)
+
+SOURCES += ARAPDeform.cpp
@@ -0,0 +1,93 @@
+#include "ARAPSolverThread.h"
+
+ARAPSolverThread::ARAPSolverThread( AsRigidAsPossible & _arap ) :
+    arap( _arap ), hasPending( false ), busy( false ), stop( false ),
+    progressive( false ), refining( false ), interrupted( false ),
+    back( 0 ), front( 1 ), spare( 2 )
+{
+}
+
+ARAPSolverThread::~ARAPSolverThread(){
+    {
+        std::lock_guard<std::mutex> lock( mutex );
+        stop = true;
+    }
+    condition.notify_all();
+    if( thread.joinable() )
+        thread.join();
+}
+
+void ARAPSolverThread::setProgressive( bool _progressive ){
+    std::lock_guard<std::mutex> lock( mutex );
+    progressive = _progressive;
+}
+
+void ARAPSolverThread::post( const std::vector<Vec3Df> & positions ){
+    // copied outside of the lock, the solver thread only waits for the swap
+    std::vector<Vec3Df> request( positions );
+    {
+        std::lock_guard<std::mutex> lock( mutex );
+        pending.swap( request );
+        hasPending = true;
+        if( !thread.joinable() )
+            thread = std::thread( &ARAPSolverThread::run, this );
+    }
+    condition.notify_all();
+}
+
+void ARAPSolverThread::wait(){
+    std::unique_lock<std::mutex> lock( mutex );
+    interrupted = true;
+    condition.wait( lock, [this]{ return !hasPending && !busy; } );
+}
+
+const ARAPSolverThread::Result * ARAPSolverThread::acquire(){
+    if( !( spare.load() & FRESH ) )
+        return NULL;
+    front = spare.exchange( front ) & ~FRESH;
+    return &slots[front];
+}
+
+void ARAPSolverThread::run(){
+    std::vector<Vec3Df> positions;
+    bool converged = true;
+    for(;;){
+        bool restart, refine;
+        {
+            std::unique_lock<std::mutex> lock( mutex );
+            busy = false;
+            refining = refining && !converged && !interrupted;
+            condition.notify_all();
+            condition.wait( lock, [this]{ return stop || hasPending || refining; } );
+            if( stop )
+                return;
+            restart = hasPending;
+            if( hasPending ){
+                positions.swap( pending );
+                hasPending = false;
+                interrupted = false;
+            }
+            refine = progressive;
+            refining = progressive;
+            busy = true;
+        }
+
+        converged = true;
+        if( refine )
+            converged = arap.refine_deformation( positions, restart ) || arap.getIterationsUsed() >= maxRefinementNb;
+        else
+            arap.compute_deformation( positions );
+
+        // the positions are kept for the next refinement
+        Result & result = slots[back];
+        result.positions = positions;
+        result.iterationsUsed = arap.getIterationsUsed();
+        result.energy = arap.getEnergy();
+        result.stats = arap.getStats();
+        result.converged = converged;
+        back = spare.exchange( back | FRESH ) & ~FRESH;
+
+        if( publishCallback )
+            publishCallback();
+    }
+}
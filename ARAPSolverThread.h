@@ -0,0 +1,94 @@
+#ifndef ARAPSOLVERTHREAD_H
+#define ARAPSOLVERTHREAD_H
+
+#include "AsRigidAsPossible.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Runs AsRigidAsPossible::compute_deformation on a thread of its own, so that
+// an interactive client never waits for a solve.
+//
+// post() hands the latest positions to the thread : a request which is not
+// started yet is replaced, so the intermediate positions of a drag are dropped
+// and the solver always works on the most recent ones.
+//
+// In progressive mode a request is solved with a single iteration, published
+// at once, then refined by one iteration at a time while no other request
+// comes, each iteration being published, until it converges
+// (AsRigidAsPossible::refine_deformation) or after maxRefinementNb iterations.
+// The coarser levels of a multiresolution solver are not used in this mode.
+//
+// Every solve is published into a double buffer with a spare slot : the solver
+// fills its back slot and exchanges it with the spare one, the client exchanges
+// its front slot with the spare one in acquire(). Neither side takes a lock or
+// waits for the other.
+//
+// The AsRigidAsPossible object must not be used by the client while a solve
+// may be running : call wait() first.
+class ARAPSolverThread
+{
+public:
+    struct Result {
+        std::vector<Vec3Df> positions;
+        unsigned int iterationsUsed;
+        double energy;
+        AsRigidAsPossible::Stats stats;
+        bool converged;
+    };
+
+    static const unsigned int maxRefinementNb = 100;
+
+    ARAPSolverThread( AsRigidAsPossible & arap );
+    ~ARAPSolverThread();
+
+    ARAPSolverThread( const ARAPSolverThread & ) = delete;
+    ARAPSolverThread & operator=( const ARAPSolverThread & ) = delete;
+
+    // Called on the solver thread each time a result is published
+    void setPublishCallback( const std::function<void()> & callback ){ publishCallback = callback; }
+
+    void setProgressive( bool progressive );
+
+    // The thread is started by the first request
+    void post( const std::vector<Vec3Df> & positions );
+
+    // Returns once the last posted positions are solved and published. A
+    // progressive refinement stops at its next iteration.
+    void wait();
+
+    // Newest result not acquired yet, NULL if there is none. It stays valid
+    // until the next call.
+    const Result * acquire();
+
+private:
+    void run();
+
+    AsRigidAsPossible & arap;
+    std::function<void()> publishCallback;
+
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::vector<Vec3Df> pending;
+    bool hasPending;
+    bool busy;
+    bool stop;
+    bool progressive;
+    // the last request is refined further, unless interrupted by wait()
+    bool refining;
+    bool interrupted;
+
+    // slot indices, FRESH marks a spare slot published and not acquired yet
+    static const unsigned int FRESH = 4;
+    Result slots[3];
+    unsigned int back;
+    unsigned int front;
+    std::atomic<unsigned int> spare;
+};
+
+#endif // ARAPSOLVERTHREAD_H
@@ -47,14 +47,18 @@ void ARAPViewer::init()
     initLightsAndMaterials();
 
     setKeyDescription(Qt::Key_D, "Change display mode");
+    setKeyDescription(Qt::Key_T, "Show/hide the ARAP solver timings");
 
     displayMode = LIGHTED;
 
     sphereScale = 0.5;
     manipulatorScale = 1.;
     deformation = false;
+    showStats = false;
+    refiningSavedState = false;
 
-    meshInterface = MMInterface< Vec3Df >();
+    // REALTIME and PROGRESSIVE deformations are solved on the thread of meshInterface
+    meshInterface.setDeformationCallback( [this](){ QMetaObject::invokeMethod( this, "deformationReady", Qt::QueuedConnection ); } );
 
 }
 
@@ -159,7 +163,14 @@ void ARAPViewer::mouseReleaseEvent(QMouseEvent* e  )
 }
 
 void ARAPViewer::manipulatorReleased(){
+    if( meshInterface.manipulatorReleased() ){
+        updateFromCMInterface(meshInterface.get_modified_vertices());
+        displayARAPReport();
+    }
     saveCurrentState();
+
+    // PROGRESSIVE : the saved state is replaced by the converged one
+    refiningSavedState = meshInterface.getMode() == PROGRESSIVE;
 }
 
 void ARAPViewer::saveCurrentState(){
@@ -283,37 +294,21 @@ void ARAPViewer::openConstraints (const QString & filename) {
     //    clear();
 
 
-    std::ifstream myfile;
-    myfile.open(filename.toStdString().c_str());
-    if (!myfile.is_open())
-    {
-        std::cout << filename.toStdString() << " cannot be opened" << std::endl;
-        return;
-    }
-
-    unsigned int v_id;
-    float x, y, z;
-
     std::vector<std::pair<int, Vec3Df> > constraints;
-    while ( myfile.good() )
-    {
-        myfile >> v_id;
-        if( myfile.good() ){
-            myfile >> x; myfile >> y; myfile >> z;
-
-            constraints.push_back(std::make_pair(v_id, Vec3Df(x,y,z)));
+    if( !FileIO::openConstraints( filename.toStdString(), constraints ) )
+        return;
 
-            if( v_id >= mesh.getVerticesNb() ){
-                std::cout <<"ARAPViewer::openConstraints::Constraints id > number of vertices "<< std::endl;
-                return ;
-            }
+    for( unsigned int i = 0 ; i < constraints.size() ; i++ ){
+        if( (unsigned int)constraints[i].first >= mesh.getVerticesNb() ){
+            std::cout <<"ARAPViewer::openConstraints::Constraints id > number of vertices "<< std::endl;
+            return ;
         }
     }
-    myfile.close();
 
     meshInterface.changedConstraints(constraints);
 
     updateFromCMInterface(meshInterface.get_modified_vertices());
+    displayARAPReport();
 }
 
 void ARAPViewer::saveCamera(const QString &filename){
@@ -382,7 +377,8 @@ void ARAPViewer::updateViewer(){
     updateCamera(center, radius);
 
     meshInterface.clear();
-    meshInterface.setMode(REALTIME);
+    if( meshInterface.getMode() != PROGRESSIVE )
+        meshInterface.setMode(REALTIME);
     meshInterface.loadAndInitialize(mesh.getVertices(), mesh.getTriangles());
 
     manipulator->clear();
@@ -415,9 +411,55 @@ void ARAPViewer::reset(){
 void ARAPViewer::updateFromCMInterface(){
 
     meshInterface.changed(manipulator);
+    refiningSavedState = false;
+
+    // REALTIME, PROGRESSIVE : the mesh is updated by deformationReady once solved
+    if( meshInterface.getMode() == INTERACTIVE )
+        updateFromCMInterface(meshInterface.get_modified_vertices());
+
+}
+
+void ARAPViewer::deformationReady(){
+
+    if( !meshInterface.fetchDeformation() )
+        return;
 
     updateFromCMInterface(meshInterface.get_modified_vertices());
+    displayARAPReport();
+
+    if( refiningSavedState && meshInterface.isDeformationConverged() ){
+        Q.back() = meshInterface.get_modified_vertices();
+        refiningSavedState = false;
+    }
+
+}
 
+void ARAPViewer::displayARAPReport(){
+    displayMessage( QString("ARAP : %1 iterations, energy %2").arg(meshInterface.getIterationsUsed()).arg(meshInterface.getEnergy()) );
+}
+
+void ARAPViewer::drawARAPStats(){
+    const AsRigidAsPossible::Stats & stats = meshInterface.getStats();
+
+    QStringList lines;
+    lines << QString("init %1 ms, analyze %2 ms, factorize %3 ms (last %4 ms)")
+             .arg(stats.init.total, 0, 'f', 1).arg(stats.analyze.total, 0, 'f', 1)
+             .arg(stats.factorize.total, 0, 'f', 1).arg(stats.factorize.last, 0, 'f', 1);
+    lines << QString("%1 factorizations, %2 low-rank updates, %3 cached factors")
+             .arg(stats.factorizations).arg(stats.factorUpdates).arg(stats.cachedFactors);
+    lines << QString("last deformation %1 ms, %2 iterations (mean %3 ms)")
+             .arg(stats.deformation.last, 0, 'f', 2).arg(stats.iterations).arg(stats.deformation.mean(), 0, 'f', 2);
+    lines << QString("per iteration : rhs %1 ms, solve %2 ms, local step %3 ms")
+             .arg(stats.rhs.last, 0, 'f', 2).arg(stats.solve.last, 0, 'f', 2).arg(stats.localStep.last, 0, 'f', 2);
+    lines << QString("nnz(A) %1, nnz(L) %2, factor %3 MB, cache %4 MB")
+             .arg(stats.nnzA).arg(stats.nnzL)
+             .arg(stats.factorBytes / 1048576., 0, 'f', 1).arg(stats.cacheBytes / 1048576., 0, 'f', 1);
+
+    glDisable(GL_LIGHTING);
+    glColor3f(0.,0.,0.);
+    for( int l = 0 ; l < lines.size() ; l++ )
+        drawText( 10, 20 + 16 * l, lines[l] );
+    glEnable(GL_LIGHTING);
 }
 
 void ARAPViewer::updateFromCMInterface( std::vector< Vec3Df > const & copoints ){
@@ -489,6 +531,9 @@ void ARAPViewer::draw(){
         glDisable(GL_BLEND);
         glEnable(GL_LIGHTING);
     }
+
+    if(showStats)
+        drawARAPStats();
 }
 
 void ARAPViewer::changeDisplayMode(){
@@ -508,6 +553,7 @@ void ARAPViewer::keyPressEvent(QKeyEvent *e)
     switch (e->key())
     {
     case Qt::Key_D : changeDisplayMode(); break;
+    case Qt::Key_T : setShowStats(!showStats); break;
     case Qt::Key_A :
         if(deformation && e->modifiers() & Qt::ControlModifier){
             manipulator->clear();
@@ -544,6 +590,7 @@ QString ARAPViewer::helpString() const
     text += "<ul>";
     text += "<li><b>H</b>   :   make this help appear.</li>";
     text += "<li><b>D</b>   :   change display mode.</li>";
+    text += "<li><b>T</b>   :   show/hide the ARAP solver timings.</li>";
     text += "<li><b>Ctrl + Q</b>   :   close the application.</li>";
     text += "</ul>";
     text += "<h4>Open</h4>";
@@ -49,6 +49,13 @@ public :
     void setTopositions(const vector<Vec3Df> & positions);
 
     unsigned int getARAPIteration(){ return meshInterface.getIterationNb(); }
+    bool getARAPHardConstraints(){ return meshInterface.getHardConstraints(); }
+    bool getARAPConjugateGradient(){ return meshInterface.getConjugateGradient(); }
+    double getARAPTolerance(){ return meshInterface.getTolerance(); }
+    unsigned int getARAPAndersonWindow(){ return meshInterface.getAndersonWindow(); }
+    unsigned int getARAPLevelNb(){ return meshInterface.getLevelNb(); }
+    unsigned int getARAPRotationClusterSize(){ return meshInterface.getRotationClusterSize(); }
+    bool getARAPProgressive(){ return meshInterface.getMode() == PROGRESSIVE; }
 protected :
     virtual void init();
     virtual void draw();
@@ -71,6 +78,9 @@ protected :
 
     void restaureLastState();
 
+    void displayARAPReport();
+    void drawARAPStats();
+
     DisplayMode displayMode;
     MMInterface< Vec3Df > meshInterface;
     SimpleManipulator * manipulator;
@@ -85,10 +95,14 @@ protected :
     double manipulatorScale;
 
     bool deformation;
+    bool showStats;
+    // the last saved state is a PROGRESSIVE deformation not converged yet
+    bool refiningSavedState;
 
 public slots :
     void manipulatorReleased();
     void updateFromCMInterface();
+    void deformationReady();
     void addToSelection(QRectF const &, bool);
     void removeFromSelection(QRectF const &);
     void computeManipulatorForDeformation();
@@ -97,8 +111,16 @@ public slots :
     void setManipulatorScale(double _mScale){manipulatorScale = _mScale; manipulator->setDisplayScale(manipulatorScale*camera()->sceneRadius()/9.);update();}
 
     void setARAPIteration(int itNb){ meshInterface.setIterationNb(itNb); }
+    void setARAPHardConstraints(bool hard){ meshInterface.setHardConstraints(hard); }
+    void setARAPConjugateGradient(bool cg){ meshInterface.setConjugateGradient(cg); }
+    void setARAPTolerance(double tolerance){ meshInterface.setTolerance(tolerance); }
+    void setARAPAndersonWindow(int m){ meshInterface.setAndersonWindow(m); }
+    void setARAPLevelNb(int levels){ meshInterface.setLevelNb(levels); }
+    void setARAPRotationClusterSize(int size){ meshInterface.setRotationClusterSize(size); }
+    void setARAPProgressive(bool progressive){ meshInterface.setMode( progressive ? PROGRESSIVE : REALTIME ); }
     void invertNormals(){ mesh.invertNormal(); update(); }
     void setDeformation(bool _deformation){ deformation = _deformation; update();}
+    void setShowStats(bool _showStats){ showStats = _showStats; update();}
     void reset();
 
 };
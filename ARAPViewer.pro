@@ -0,0 +1,31 @@
+TEMPLATE = app
+TARGET = arapFramework
+DISTFILES += *.png
+QT *= xml \
+    opengl
+CONFIG += console \
+    embed_manifest_exe \
+    qt \
+    opengl
+
+include(ARAPCommon.pri)
+include(ARAPCore.pri)
+
+HEADERS += Window.h \
+    ARAPViewer.h \
+    GLUtilityMethods.h \
+    openglincludeQtComp.h \
+    Manipulator/PCATools.h \
+    Manipulator/Manipulator.h \
+    Manipulator/RectangleSelection.h \
+    MeshManipInterface.h
+SOURCES += Window.cpp \
+    ARAPViewer.cpp \
+    Main.cpp \
+    GLUtilityMethods.cpp \
+    MeshDraw.cpp
+LIBS += -lgslcblas \
+    -lgsl \
+    -lQGLViewer-qt5 \
+    -lglut \
+    -lGLU
@@ -1,58 +1,126 @@
 #include "AsRigidAsPossible.h"
 #include "math.h"
-#include "GLUtilityMethods.h"
-#include <gsl/gsl_blas.h>
+#include "RotationFitting.h"
+#include "MeshAdjacency.h"
 #include <algorithm>
+#include <chrono>
+#include <functional>
+#include <limits>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// Vertices handed to RotationFitting::closestRotations at once by a thread
+#define ROTATION_FITTING_CHUNK 1024
+
+// Vertices of a partial dot product of the conjugate gradient
+#define CONJUGATE_GRADIENT_CHUNK 4096
+
+// Milliseconds elapsed since start, for the Stats timings
+static double elapsed_ms( const std::chrono::steady_clock::time_point & start ){
+    return std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+}
 
 AsRigidAsPossible::AsRigidAsPossible()
 {
     iterationNb = 5;
+#ifdef _OPENMP
+    threadNb = std::max( omp_get_max_threads(), 1 );
+#else
+    threadNb = 1;
+#endif
+    tolerance = 0.;
+    restScale = 1.;
+    andersonWindow = 0;
+    anderson_reset();
+    levelNb = 1;
+    fineIterationNb = 2;
+    coarser = NULL;
+    rotationClusterSize = 1;
+    energy = 0.;
+    step = 0;
+    updateThreshold = 128;
+    factorCacheBytes = 0;
+    factorCacheBudget = 256 << 20;
+    constraintMode = SOFT;
+    constrainedNb = 0;
+    linearSolver = CHOLESKY;
+    factorization = FACTORIZATION_AUTO;
+    ordering = ORDERING_AUTO;
+    blasThreadNb = 0;
+    cgTolerance = 1e-6;
+    cgIterationNb = 1000;
+    cgIterationsUsed = 0;
+    cgPreconditioner = JACOBI;
+
+    _Lap = NULL;
+    _A = NULL;
+    _L = NULL;
+    _superL = NULL;
+    _b = NULL;
+    _Atb = NULL;
+    _x = NULL;
+    _Y = NULL;
+    _E = NULL;
+    borrowedSystem = false;
     data_loaded = false;
 }
 
 AsRigidAsPossible::~AsRigidAsPossible(){
 
-    if(data_loaded){
-        cholmod_free_triplet(&_triplet, &_c);
-        cholmod_free_sparse(&_At, &_c);
-        cholmod_free_factor(&_L, &_c);
-        cholmod_free_dense(&_b, &_c);
-
-        for(unsigned int i = 0 ; i < R.size() ; i++ )
-            gsl_matrix_free (R[i]);
-        R.clear();
-
-        delete [] _rowPtrA;
-        delete [] _colPtrA;
-        delete [] _valuePtrA;
-        delete [] _valuePtrB;
-    }
+    clear();
 }
 
 void AsRigidAsPossible::clear(){
 
     if(data_loaded){
-        cholmod_free_triplet(&_triplet, &_c);
-        cholmod_free_sparse(&_At, &_c);
-        cholmod_free_factor(&_L, &_c);
+        if( borrowedSystem ){
+            _Lap = NULL;
+            _L = NULL;
+            borrowedSystem = false;
+        }
+        free_cholmod_A_system();
         cholmod_free_dense(&_b, &_c);
+        cholmod_free_dense(&_Atb, &_c);
+        cholmod_free_dense(&_x, &_c);
+        cholmod_free_dense(&_Y, &_c);
+        cholmod_free_dense(&_E, &_c);
+        cholmod_finish(&_c);
 
-        for(unsigned int i = 0 ; i < R.size() ; i++ )
-            gsl_matrix_free (R[i]);
         R.clear();
-
-        delete [] _rowPtrA;
-        delete [] _colPtrA;
-        delete [] _valuePtrA;
-        delete [] _valuePtrB;
+        rotationClusterOffsets.clear();
+        rotationClusterVertices.clear();
+        rotationClusters.clear();
 
         vertices.clear();
-        edgesWeightMap.clear();
-        bij.clear();
         handles.clear();
-        oneRing.clear();
+        oneRingOffsets.clear();
+        oneRingNeighbors.clear();
+        oneRingWeights.clear();
+        oneRingBij.clear();
 
         sumWij.clear();
+        localS.clear();
+        localR.clear();
+        chunkEnergies.clear();
+
+        delete coarser;
+        coarser = NULL;
+        fineToCoarse.clear();
+        coarseRepresentatives.clear();
+        coarseHandleCounts.clear();
+        coarsePositions.clear();
+
+        cgX.clear(); cgR.clear(); cgZ.clear(); cgP.clear(); cgQ.clear(); cgB.clear(); cgT.clear();
+        cgInverseDiagonal.clear();
+        cgPartialDots.clear();
+        icOffsets.clear(); icColumns.clear(); icValues.clear(); icSystem.clear();
+
+        iterationEnergies.clear();
+        iterationChanges.clear();
+        energy = 0.;
+        constrainedNb = 0;
         data_loaded = false;
     }
 
@@ -69,109 +137,396 @@ void AsRigidAsPossible::init( const std::vector<Vec3Df> & _vertices, const std::
 
 void AsRigidAsPossible::init( const std::vector<Vec3Df> & _vertices, const std::vector< Triangle > & _triangles ){
 
+    clear();
+
+    stats = Stats();
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
     vertices = _vertices;
     
-    edgesWeightMap.clear();
-    bij.clear();
-    
-    oneRing.clear();
-    oneRing.resize (vertices.size ());
     handles.clear();
     handles.resize(vertices.size(), false);
     constrainedNb = 0;
 
-    for( unsigned int i = 0 ; i < _triangles.size() ; i ++ ){
-        
-        const Triangle & triangle = _triangles[i];
-        
-        Vec3Df p1 = vertices[triangle.getVertex(0)];
-        Vec3Df p2 = vertices[triangle.getVertex(1)];
-        Vec3Df p3 = vertices[triangle.getVertex(2)];
+    std::chrono::steady_clock::time_point adjacencyStart = std::chrono::steady_clock::now();
+    MeshAdjacency::cotangentOneRing( vertices, _triangles, oneRingOffsets, oneRingNeighbors, oneRingWeights, threadNb );
+    buildOneRingTable();
+    stats.adjacency.add( elapsed_ms( adjacencyStart ) );
 
-        float e1sq = ( p2 - p1 ).getSquaredLength();
-        float e2sq = ( p2 - p3 ).getSquaredLength();
-        float e3sq = ( p3 - p1 ).getSquaredLength();
+    setDefaultRotations();
 
-        float e1e2 = Vec3Df::dotProduct( p2 - p1 , p3 - p2 );
-        float e2e3 = Vec3Df::dotProduct( p3 - p1 , p3 - p2 );
-        float e3e1 = Vec3Df::dotProduct( p2 - p1 , p3 - p1 );
+    build_rotation_clusters();
 
-        float cot1 = e1sq / ( 2.f * sqrt( ( e2sq * e3sq / ( e2e3 * e2e3 ) ) - 1.f ) );
-        float cot2 = e2sq / ( 2.f * sqrt( ( e1sq * e3sq / ( e3e1 * e3e1 ) ) - 1.f ) );
-        float cot3 = e3sq / ( 2.f * sqrt( ( e2sq * e1sq / ( e1e2 * e1e2 ) ) - 1.f ) );
+    Vec3Df bbMin = vertices.empty() ? Vec3Df(0.,0.,0.) : vertices[0], bbMax = bbMin;
+    for( unsigned int i = 0 ; i < vertices.size() ; i ++ ){
+        for( int k = 0 ; k < 3 ; k++ ){
+            bbMin[k] = std::min( bbMin[k], vertices[i][k] );
+            bbMax[k] = std::max( bbMax[k], vertices[i][k] );
+        }
+    }
+    restScale = std::max( ( bbMax - bbMin ).getLength(), std::numeric_limits<float>::min() );
 
+    setAndersonWindow( andersonWindow );
 
+    cholmod_start(&_c);
+    configure_cholmod();
+    data_loaded = true;
 
-        Edge edge1( triangle.getVertex(0) , triangle.getVertex(1) );
-        Edge edge2( triangle.getVertex(1) , triangle.getVertex(2) );
-        Edge edge3( triangle.getVertex(2) , triangle.getVertex(0) );
+    if( levelNb > 1 )
+        build_coarser_level( _triangles );
 
-        CotangentWeights::iterator it = edgesWeightMap.find(edge1);
-        if( it != edgesWeightMap.end() ){
-            it->second = (it->second + cot1)/2.;
-            bij[it->first] = (vertices[it->first.v[1]] - vertices[it->first.v[0]]) * it->second/2.;
-        } else {
-            edgesWeightMap[edge1] = cot1;
-            bij[edge1] = (vertices[edge1.v[1]] - vertices[edge1.v[0]]) * cot1/2.;
-        }
+    stats.init.add( elapsed_ms( start ) );
+}
 
-        it = edgesWeightMap.find(edge2);
-        if( it != edgesWeightMap.end() ){
-            it->second = (it->second + cot2)/2.;
-            bij[it->first] = (vertices[it->first.v[1]] - vertices[it->first.v[0]]) * it->second/2.;
-        } else {
-            edgesWeightMap[edge2] = cot2;
-            bij[edge2] = (vertices[edge2.v[1]] - vertices[edge2.v[0]]) * cot2/2.;
+void AsRigidAsPossible::setRotationClusterSize( unsigned int size ){
+
+    rotationClusterSize = std::max( size, 1u );
+    if( data_loaded )
+        build_rotation_clusters();
+}
+
+void AsRigidAsPossible::build_rotation_clusters(){
+
+    rotationClusterOffsets.clear();
+    rotationClusterVertices.clear();
+    rotationClusters.clear();
+
+    const unsigned int n = vertices.size();
+    if( rotationClusterSize <= 1 || n == 0 )
+        return;
+
+    // Regions of rotationClusterSize vertices grown one after the other by
+    // Dijkstra over the edges, each one seeded next to the previous ones
+    const unsigned int none = n;
+    rotationClusters.assign( n, none );
+    std::vector< unsigned int > sizes;
+    std::vector< float > distances( n, std::numeric_limits<float>::max() );
+    std::vector< std::pair< float, unsigned int > > front;
+    std::vector< unsigned int > seeds, reached;
+    unsigned int seedHead = 0, nextVertex = 0;
+
+    for( ; ; ){
+        while( seedHead < seeds.size() && rotationClusters[seeds[seedHead]] != none )
+            seedHead++;
+        while( nextVertex < n && rotationClusters[nextVertex] != none )
+            nextVertex++;
+        unsigned int seed = seedHead < seeds.size() ? seeds[seedHead] : nextVertex;
+        if( seed == n )
+            break;
+
+        const unsigned int cluster = sizes.size();
+        unsigned int size = 0;
+        front.push_back( std::make_pair( 0.f, seed ) );
+        distances[seed] = 0.;
+        reached.push_back( seed );
+
+        while( !front.empty() && size < rotationClusterSize ){
+            std::pop_heap( front.begin(), front.end(), std::greater< std::pair< float, unsigned int > >() );
+            float d = front.back().first;
+            unsigned int i = front.back().second;
+            front.pop_back();
+            if( rotationClusters[i] != none || d > distances[i] )
+                continue;
+
+            rotationClusters[i] = cluster;
+            size++;
+            for( unsigned int h = oneRingOffsets[i] ; h < oneRingOffsets[i+1] ; h++ ){
+                unsigned int j = oneRingNeighbors[h];
+                float dj = d + ( vertices[j] - vertices[i] ).getLength();
+                if( rotationClusters[j] == none && dj < distances[j] ){
+                    distances[j] = dj;
+                    reached.push_back( j );
+                    front.push_back( std::make_pair( dj, j ) );
+                    std::push_heap( front.begin(), front.end(), std::greater< std::pair< float, unsigned int > >() );
+                }
+            }
         }
+        sizes.push_back( size );
+
+        // the vertices left on the front seed the next regions
+        for( unsigned int k = 0 ; k < front.size() ; k++ )
+            if( rotationClusters[front[k].second] == none )
+                seeds.push_back( front[k].second );
+        front.clear();
+        for( unsigned int k = 0 ; k < reached.size() ; k++ )
+            distances[reached[k]] = std::numeric_limits<float>::max();
+        reached.clear();
+    }
 
-        it = edgesWeightMap.find(edge3);
-        if( it != edgesWeightMap.end() ){
-            it->second = (it->second + cot3)/2.;
-            bij[it->first] = (vertices[it->first.v[1]] - vertices[it->first.v[0]]) * it->second/2.;
-        } else {
-            edgesWeightMap[edge3] = cot3;
-            bij[edge3] = (vertices[edge3.v[1]] - vertices[edge3.v[0]]) * cot3/2.;
+    // the fragments left between full regions join a neighbouring region
+    std::vector< unsigned int > target( sizes.size() );
+    for( unsigned int c = 0 ; c < sizes.size() ; c++ )
+        target[c] = c;
+    for( unsigned int i = 0 ; i < n ; i ++ ){
+        unsigned int c = rotationClusters[i];
+        if( 2 * sizes[c] >= rotationClusterSize || target[c] != c )
+            continue;
+        for( unsigned int h = oneRingOffsets[i] ; h < oneRingOffsets[i+1] ; h++ ){
+            unsigned int cj = rotationClusters[oneRingNeighbors[h]];
+            if( 2 * sizes[cj] >= rotationClusterSize ){
+                target[c] = cj;
+                break;
+            }
         }
+    }
+
+    std::vector< unsigned int > index( sizes.size(), none );
+    unsigned int clusterNb = 0;
+    for( unsigned int c = 0 ; c < sizes.size() ; c++ )
+        if( target[c] == c )
+            index[c] = clusterNb++;
+
+    rotationClusterOffsets.assign( clusterNb + 1, 0 );
+    for( unsigned int i = 0 ; i < n ; i ++ ){
+        rotationClusters[i] = index[target[rotationClusters[i]]];
+        rotationClusterOffsets[rotationClusters[i] + 1]++;
+    }
+    for( unsigned int c = 0 ; c < clusterNb ; c++ )
+        rotationClusterOffsets[c + 1] += rotationClusterOffsets[c];
+
+    std::vector< unsigned int > fill( rotationClusterOffsets.begin(), rotationClusterOffsets.end() - 1 );
+    rotationClusterVertices.resize( n );
+    for( unsigned int i = 0 ; i < n ; i ++ )
+        rotationClusterVertices[fill[rotationClusters[i]]++] = i;
+}
 
-        /*
+// Smallest mesh worth a coarser level
+#define COARSE_LEVEL_MIN_VERTICES 256
 
-        Vec3Df e[3] = { vertices[ triangle.getVertex(1) ] - vertices[ triangle.getVertex(0) ],
-                            vertices[ triangle.getVertex(2) ] - vertices[ triangle.getVertex(1) ],
-                            vertices[ triangle.getVertex(0) ] - vertices[ triangle.getVertex(2) ]};
+static unsigned int find_cluster( std::vector< unsigned int > & parent , unsigned int i ){
+    while( parent[i] != i ){
+        parent[i] = parent[parent[i]];
+        i = parent[i];
+    }
+    return i;
+}
 
-        for( int v = 0 ; v < 3 ; v++ )
-            e[v].normalize();
+void AsRigidAsPossible::build_coarser_level( const std::vector< Triangle > & triangles ){
 
+    const unsigned int n = vertices.size();
+    const unsigned int halfEdgesNb = oneRingOffsets[n];
+    if( n < COARSE_LEVEL_MIN_VERTICES || halfEdgesNb == 0 )
+        return;
 
+    // grid cells of twice the mean edge length, about four vertices each
+    double edgeLengths = 0.;
+    for( unsigned int i = 0 ; i < n ; i ++ )
+        for( unsigned int h = oneRingOffsets[i] ; h < oneRingOffsets[i+1] ; h++ )
+            edgeLengths += ( vertices[oneRingNeighbors[h]] - vertices[i] ).getLength();
+    const float cell = std::max( 2. * edgeLengths / halfEdgesNb, (double)std::numeric_limits<float>::min() );
+
+    Vec3Df bbMin = vertices[0];
+    for( unsigned int i = 0 ; i < n ; i ++ )
+        for( int k = 0 ; k < 3 ; k++ )
+            bbMin[k] = std::min( bbMin[k], vertices[i][k] );
+
+    std::vector< unsigned long long > cellKeys( n );
+    for( unsigned int i = 0 ; i < n ; i ++ ){
+        unsigned long long key = 0;
+        for( int k = 0 ; k < 3 ; k++ )
+            key = ( key << 21 ) | ( (unsigned long long)( ( vertices[i][k] - bbMin[k] ) / cell ) & 0x1FFFFF );
+        cellKeys[i] = key;
+    }
 
-            Edge edge( triangle.getVertex(v) , triangle.getVertex( (v+1)%3 ) );
-            float w = 1. / tan( acos( dofProduct( -1.*e[ (v+1)%3 ], e[ (v+2)%3 ] ) ) );
-            
-            CotangentWeights::iterator it = edgesWeightMap.find(edge);
-            if( it != edgesWeightMap.end() ){
-                w = ( w + it->second )/2. ;
-                it->second = w;
-                bij[it->first] = (vertices[it->first.v[0]] - vertices[it->first.v[1]]) * it->second/2.;
-            } else {
-                edgesWeightMap[edge] = w;
+    // a cluster is a connected part of the mesh inside a cell, so that two
+    // sheets crossing the same cell are not merged
+    std::vector< unsigned int > parent( n );
+    for( unsigned int i = 0 ; i < n ; i ++ )
+        parent[i] = i;
+    for( unsigned int i = 0 ; i < n ; i ++ ){
+        for( unsigned int h = oneRingOffsets[i] ; h < oneRingOffsets[i+1] ; h++ ){
+            unsigned int j = oneRingNeighbors[h];
+            if( cellKeys[i] == cellKeys[j] ){
+                unsigned int ri = find_cluster( parent, i ), rj = find_cluster( parent, j );
+                if( ri != rj ) parent[std::max( ri, rj )] = std::min( ri, rj );
             }
-*/
-        for( int v = 0 ; v < 3 ; v++ ){
-            unsigned int vj = triangle.getVertex (v);
-            for (unsigned int k = 1; k < 3; k++) {
-                unsigned int vk = triangle.getVertex ((v+k)%3);
-
-                if (std::find (oneRing[vj].begin(), oneRing[vj].end(), vk) == oneRing[vj].end ())
-                    oneRing[vj].push_back (vk);
+        }
+    }
+    for( unsigned int i = 0 ; i < n ; i ++ )
+        parent[i] = find_cluster( parent, i );
+
+    std::vector< Triangle > coarseTriangles;
+    std::vector< bool > used;
+    for( int pass = 0 ; ; pass++ ){
+        // consecutive cluster indices
+        std::vector< unsigned int > index( n, n );
+        unsigned int clusterNb = 0;
+        fineToCoarse.resize( n );
+        for( unsigned int i = 0 ; i < n ; i ++ ){
+            unsigned int r = parent[i];
+            if( index[r] == n ) index[r] = clusterNb++;
+            fineToCoarse[i] = index[r];
+        }
+
+        // the fine triangles spanning three clusters, without duplicates
+        // and without the (nearly) flat ones whose cotangents blow up
+        coarseTriangles.clear();
+        std::vector< std::pair< std::pair< unsigned int, unsigned int >, std::pair< unsigned int, unsigned int > > > coarseTriangleKeys;
+        used.assign( clusterNb, false );
+        for( unsigned int t = 0 ; t < triangles.size() ; t++ ){
+            unsigned int c[3];
+            for( int v = 0 ; v < 3 ; v++ )
+                c[v] = fineToCoarse[triangles[t].getVertex(v)];
+            if( c[0] == c[1] || c[1] == c[2] || c[2] == c[0] )
+                continue;
+
+            unsigned int s[3] = { c[0], c[1], c[2] };
+            std::sort( s, s + 3 );
+            coarseTriangleKeys.push_back( std::make_pair( std::make_pair( s[0], s[1] ), std::make_pair( s[2], t ) ) );
+        }
+        std::sort( coarseTriangleKeys.begin(), coarseTriangleKeys.end() );
+
+        coarseRepresentatives.assign( clusterNb, n );
+        std::vector< Vec3Df > centroids( clusterNb, Vec3Df( 0., 0., 0. ) );
+        std::vector< unsigned int > sizes( clusterNb, 0 );
+        for( unsigned int i = 0 ; i < n ; i ++ ){
+            centroids[fineToCoarse[i]] += vertices[i];
+            sizes[fineToCoarse[i]] ++;
+        }
+        for( unsigned int i = 0 ; i < n ; i ++ ){
+            unsigned int c = fineToCoarse[i];
+            Vec3Df centroid = centroids[c] / (float)sizes[c];
+            unsigned int r = coarseRepresentatives[c];
+            if( r == n || ( vertices[i] - centroid ).getSquaredLength() < ( vertices[r] - centroid ).getSquaredLength() )
+                coarseRepresentatives[c] = i;
+        }
+
+        for( unsigned int k = 0 ; k < coarseTriangleKeys.size() ; k++ ){
+            if( k > 0 && coarseTriangleKeys[k].first == coarseTriangleKeys[k-1].first &&
+                    coarseTriangleKeys[k].second.first == coarseTriangleKeys[k-1].second.first )
+                continue;
+
+            const Triangle & triangle = triangles[coarseTriangleKeys[k].second.second];
+            unsigned int c[3];
+            for( int v = 0 ; v < 3 ; v++ )
+                c[v] = fineToCoarse[triangle.getVertex(v)];
+
+            Vec3Df e1 = vertices[coarseRepresentatives[c[1]]] - vertices[coarseRepresentatives[c[0]]];
+            Vec3Df e2 = vertices[coarseRepresentatives[c[2]]] - vertices[coarseRepresentatives[c[0]]];
+            float longest = std::max( std::max( e1.getSquaredLength(), e2.getSquaredLength() ), ( e2 - e1 ).getSquaredLength() );
+            if( Vec3Df::crossProduct( e1, e2 ).getSquaredLength() <= 1e-6f * longest * longest )
+                continue;
+
+            coarseTriangles.push_back( Triangle( c[0], c[1], c[2] ) );
+            for( int v = 0 ; v < 3 ; v++ )
+                used[c[v]] = true;
+        }
+
+        // a cluster left without triangle would have an empty row in the
+        // Laplacian : merge it into a neighbouring cluster and start again
+        bool merged = false;
+        for( unsigned int i = 0 ; i < n ; i ++ ){
+            if( used[fineToCoarse[i]] ) continue;
+            for( unsigned int h = oneRingOffsets[i] ; h < oneRingOffsets[i+1] ; h++ ){
+                unsigned int j = oneRingNeighbors[h];
+                if( used[fineToCoarse[j]] ){
+                    parent[i] = parent[j];
+                    merged = true;
+                    break;
+                }
             }
+        }
+        if( !merged || pass == 8 )
+            break;
+    }
+
+    // clustering does not decimate this mesh any further
+    const unsigned int clusterNb = coarseRepresentatives.size();
+    if( 3 * clusterNb > 2 * n ){
+        fineToCoarse.clear();
+        coarseRepresentatives.clear();
+        return;
+    }
+
+    std::vector< Vec3Df > coarseVertices( clusterNb );
+    for( unsigned int c = 0 ; c < clusterNb ; c++ )
+        coarseVertices[c] = vertices[coarseRepresentatives[c]];
+
+    coarser = new AsRigidAsPossible();
+    coarser->levelNb = levelNb - 1;
+    coarser->constraintMode = constraintMode;
+    coarser->linearSolver = linearSolver;
+    coarser->cgPreconditioner = cgPreconditioner;
+    coarser->factorization = factorization;
+    coarser->ordering = ordering;
+    configure_coarser();
+    coarser->init( coarseVertices, coarseTriangles );
+
+    coarseHandleCounts.assign( clusterNb, 0 );
+    coarsePositions = coarseVertices;
+}
+
+void AsRigidAsPossible::configure_coarser(){
+
+    coarser->iterationNb = iterationNb;
+    coarser->fineIterationNb = fineIterationNb;
+    coarser->tolerance = tolerance;
+    coarser->threadNb = threadNb;
+    coarser->updateThreshold = updateThreshold;
+    coarser->factorCacheBudget = factorCacheBudget;
+    coarser->cgTolerance = cgTolerance;
+    coarser->cgIterationNb = cgIterationNb;
+    if( coarser->andersonWindow != andersonWindow )
+        coarser->setAndersonWindow( andersonWindow );
+}
+
+void AsRigidAsPossible::restrict_to_coarser( const std::vector<Vec3Df> & positions ){
+
+    // free clusters start from the position of their representative, handle
+    // clusters follow the mean displacement of their handles
+    const std::vector<Vec3Df> & coarseVertices = coarser->vertices;
+    for( unsigned int c = 0 ; c < coarsePositions.size() ; c++ )
+        coarsePositions[c] = coarseHandleCounts[c] > 0 ? Vec3Df( 0., 0., 0. ) : positions[coarseRepresentatives[c]];
+
+    for( unsigned int i = 0 ; i < vertices.size() ; i ++ )
+        if( handles[i] )
+            coarsePositions[fineToCoarse[i]] += positions[i] - vertices[i];
 
+    for( unsigned int c = 0 ; c < coarsePositions.size() ; c++ )
+        if( coarseHandleCounts[c] > 0 )
+            coarsePositions[c] = coarseVertices[c] + coarsePositions[c] / (float)coarseHandleCounts[c];
+}
+
+void AsRigidAsPossible::prolongate_from_coarser( std::vector<Vec3Df> & positions ){
+
+    // every vertex takes the rotation of its cluster and is placed rigidly
+    // with it around the representative
+    const int n = vertices.size();
+
+#pragma omp parallel for num_threads(threadNb) schedule(static)
+    for( int i = 0 ; i < n ; i ++ ){
+        unsigned int c = fineToCoarse[i];
+        R[i] = coarser->R[c];
+        if( handles[i] ) continue;
+
+        Vec3Df p = coarsePositions[c];
+        double M[9];
+        for( int k = 0 ; k < 9 ; k++ )
+            M[k] = R[i].m[k];
+        compute_product_and_sum( M, vertices[i] - vertices[coarseRepresentatives[c]], p );
+        positions[i] = p;
+    }
+}
+
+void AsRigidAsPossible::buildOneRingTable(){
+
+    const int n = vertices.size();
+    oneRingBij.resize( oneRingNeighbors.size() );
+    sumWij.resize( n );
+
+#pragma omp parallel for num_threads(threadNb) schedule(static)
+    for( int i = 0 ; i < n ; i ++ ){
+        float sum = 0.;
+        for( unsigned int h = oneRingOffsets[i] ; h < oneRingOffsets[i+1] ; h++ ){
+            float wij = oneRingWeights[h];
+            oneRingBij[h] = (vertices[i] - vertices[oneRingNeighbors[h]]) * wij/2.;
+            sum += wij;
         }
+        sumWij[i] = sum;
     }
-    
-    setDefaultRotations();
 }
 
-void AsRigidAsPossible::setHandles(const std::vector< bool > & _handles){
+bool AsRigidAsPossible::setHandles(const std::vector< bool > & _handles){
 
     handles = _handles;
     
@@ -179,30 +534,175 @@ void AsRigidAsPossible::setHandles(const std::vector< bool > & _handles){
     for( unsigned int i = 0 ; i < handles.size() ; i ++ )
         if( handles[i] ) constrainedNb++;
 
-    if( constrainedNb == 0 ) return;
+    if( coarser != NULL ){
+        std::fill( coarseHandleCounts.begin(), coarseHandleCounts.end(), 0 );
+        for( unsigned int i = 0 ; i < handles.size() ; i ++ )
+            if( handles[i] ) coarseHandleCounts[fineToCoarse[i]]++;
+
+        std::vector< bool > coarseHandles( coarseHandleCounts.size() );
+        for( unsigned int c = 0 ; c < coarseHandleCounts.size() ; c++ )
+            coarseHandles[c] = coarseHandleCounts[c] > 0;
+        if( !coarser->setHandles( coarseHandles ) ){
+            constrainedNb = 0;
+            return false;
+        }
+    }
 
-    cholmod_start(&_c);
-    allocates_cholmod_A_and_b();
+    if( constrainedNb == 0 ) return true;
+
+    if( linearSolver == CONJUGATE_GRADIENT ){
+        _cols = vertices.size();
+        allocates_cholmod_b();
+        compute_cg_preconditioner();
+        return true;
+    }
+
+    // same handle set as the current factorization : only the positions of
+    // the handles change, which is handled by the right hand side
+    if( _L != NULL && handles == _factorHandles ) return true;
+
+    if( _A == NULL && !analyze_cholmod_A_system() )
+        return cholmod_failure( "analysis" );
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    allocates_cholmod_b();
     fill_cholmod_A();
-    factorize_cholmod_A_system();
+    if( swap_cached_factor() ){
+        stats.cachedFactors++;
+    } else {
+        cache_factor();
+        if( update_cholmod_factor() ){
+            stats.factorUpdates++;
+        } else {
+            if( !factorize_cholmod_A_system() )
+                return cholmod_failure( "factorization" );
+            stats.factorizations++;
+        }
+    }
+    _factorHandles = handles;
+    stats.factorize.add( elapsed_ms( start ) );
+    update_factor_stats();
+    return true;
 }
 
+bool AsRigidAsPossible::cholmod_failure( const char * step ){
 
-void AsRigidAsPossible::setDefaultRotations(){
+    std::cout << "AsRigidAsPossible::setHandles::CHOLMOD " << step << " failed (status " << _c.status << ")" << std::endl;
+    free_cholmod_A_system();
+    constrainedNb = 0;
+    return false;
+}
 
-    for(unsigned int i = 0 ; i < R.size() ; i++ )
-        gsl_matrix_free (R[i]);
-    R.clear();
-    R.resize(vertices.size());
+void AsRigidAsPossible::setLinearSolver(LinearSolver solver){
 
-    for( unsigned int i = 0 ; i < vertices.size() ; i ++ ){
+    if( solver == linearSolver ) return;
+
+    linearSolver = solver;
+
+    if( coarser != NULL )
+        coarser->setLinearSolver( solver );
+
+    // the factorization is not needed by the conjugate gradient
+    if( data_loaded )
+        free_cholmod_A_system();
+
+    if( constrainedNb > 0 )
+        setHandles( handles );
+}
+
+void AsRigidAsPossible::setConjugateGradientPreconditioner(Preconditioner preconditioner){
+
+    if( preconditioner == cgPreconditioner ) return;
+
+    cgPreconditioner = preconditioner;
+
+    if( coarser != NULL )
+        coarser->setConjugateGradientPreconditioner( preconditioner );
+
+    if( linearSolver == CONJUGATE_GRADIENT && constrainedNb > 0 )
+        compute_cg_preconditioner();
+}
+
+void AsRigidAsPossible::setFactorization(Factorization _factorization){
+
+    if( _factorization == factorization ) return;
+
+    factorization = _factorization;
 
-        R[i] = gsl_matrix_alloc(3, 3);
+    if( coarser != NULL )
+        coarser->setFactorization( factorization );
 
-        gsl_matrix_set_identity( R[i] );
+    // the symbolic analysis depends on the factorization kind
+    if( data_loaded ){
+        configure_cholmod();
+        free_cholmod_A_system();
+    }
+
+    if( constrainedNb > 0 )
+        setHandles( handles );
+}
+
+void AsRigidAsPossible::setOrdering(Ordering _ordering){
 
+    if( _ordering == ordering ) return;
+
+    ordering = _ordering;
+
+    if( coarser != NULL )
+        coarser->setOrdering( ordering );
+
+    if( data_loaded ){
+        configure_cholmod();
+        free_cholmod_A_system();
     }
 
+    if( constrainedNb > 0 )
+        setHandles( handles );
+}
+
+extern "C" void openblas_set_num_threads( int ) __attribute__((weak));
+extern "C" void mkl_set_num_threads( int ) __attribute__((weak));
+
+void AsRigidAsPossible::setBlasThreadNb(unsigned int thNb){
+
+    blasThreadNb = thNb;
+    if( blasThreadNb == 0 ) return;
+
+    if( openblas_set_num_threads != NULL )
+        openblas_set_num_threads( blasThreadNb );
+    if( mkl_set_num_threads != NULL )
+        mkl_set_num_threads( blasThreadNb );
+}
+
+void AsRigidAsPossible::setConstraintMode(ConstraintMode mode){
+
+    if( mode == constraintMode ) return;
+
+    constraintMode = mode;
+
+    if( coarser != NULL )
+        coarser->setConstraintMode( mode );
+
+    // the pattern of the system changes with the mode
+    if( data_loaded )
+        free_cholmod_A_system();
+
+    if( constrainedNb > 0 )
+        setHandles( handles );
+}
+
+
+void AsRigidAsPossible::setDefaultRotations(){
+
+    R.resize(vertices.size());
+
+    for( unsigned int i = 0 ; i < vertices.size() ; i ++ )
+        R[i].setIdentity();
+
+    localS.resize( 9 * vertices.size() );
+    localR.resize( 9 * vertices.size() );
+    chunkEnergies.resize( ( vertices.size() + ROTATION_FITTING_CHUNK - 1 ) / ROTATION_FITTING_CHUNK );
+
 }
 
 void AsRigidAsPossible::compute_deformation(std::vector<Vec3Df> & positions){
@@ -211,162 +711,537 @@ void AsRigidAsPossible::compute_deformation(std::vector<Vec3Df> & positions){
         return;
     }
 
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
 
-    int nb_found = 0;
-    for( unsigned int i = 0 ; i < vertices.size() ; i ++ ){
-        if( handles[i] ){
-            set_b_value( vertices.size() + nb_found, sumWij[i] * positions[i]);
-            nb_found++;
-        }
+    set_handle_positions( positions );
+
+    // the coarser levels provide the initial guess, a few iterations refine it
+    unsigned int levelIterationNb = iterationNb;
+    if( coarser != NULL ){
+        configure_coarser();
+        restrict_to_coarser( positions );
+        coarser->compute_deformation( coarsePositions );
+        prolongate_from_coarser( positions );
+        levelIterationNb = fineIterationNb;
     }
 
-    gsl_matrix * M = gsl_matrix_alloc(3, 3);
-    gsl_matrix * S = gsl_matrix_alloc(3, 3);
+    iterationEnergies.reserve( levelIterationNb );
+    iterationChanges.reserve( levelIterationNb );
+    iterationEnergies.clear();
+    iterationChanges.clear();
+    energy = 0.;
+    cgIterationsUsed = 0;
 
-    gsl_matrix * U = gsl_matrix_alloc(3, 3);
-    gsl_matrix * V = gsl_matrix_alloc(3, 3);
+    if( andersonWindow > 0 )
+        anderson_reset();
 
     step = 0;
-    while(step < iterationNb){
-        for( unsigned int i = 0 ; i < vertices.size() ; i ++ ){
-            //   if( !handles[i] ){
+    while(step < levelIterationNb){
+
+        if( andersonWindow > 0 )
+            anderson_store( positions, anderson.x );
+
+        float change = global_step( positions );
+
+        bool accelerated = andersonWindow > 0 && step > 0 && anderson_step( positions );
+
+        double previousEnergy = energy;
+        energy = local_step( positions );
+
+        // safeguard : the accelerated positions increased the energy, take
+        // the plain local-global step instead and restart the history
+        if( accelerated && energy > previousEnergy ){
+            anderson_restore( anderson.g, positions );
+            energy = local_step( positions );
+            anderson_reset();
+        }
+
+        iterationEnergies.push_back( energy );
+        iterationChanges.push_back( change );
+        step ++;
+
+        // converged when neither the energy nor the positions move anymore
+        if( tolerance > 0. && step > 1 &&
+                fabs( previousEnergy - energy ) <= tolerance * previousEnergy && change <= tolerance )
+            break;
+    }
+    //compute_guess()
+
+    stats.iterations = step;
+    stats.totalIterations += step;
+    stats.deformation.add( elapsed_ms( start ) );
+}
+
+bool AsRigidAsPossible::refine_deformation(std::vector<Vec3Df> & positions, bool restart){
 
-            Vec3Df p (0.,0.,0.);
+    if( constrainedNb == 0 ) {
+        return true;
+    }
 
-            for( unsigned int v = 0 ; v < oneRing[i].size() ; v++ ){
-                gsl_matrix_set_zero (M);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
 
-                unsigned int j = oneRing[i][v];
-                Edge e(i,j);
+    set_handle_positions( positions );
+
+    if( restart ){
+        iterationEnergies.clear();
+        iterationChanges.clear();
+        cgIterationsUsed = 0;
+        step = 0;
+    }
 
-                gsl_matrix_add(M , R[i]);
-                gsl_matrix_add(M , R[j]);
-                float prod = -1.;
-                if(j < i) prod = 1.;
-                compute_product_and_sum( M, bij[e]*prod, p );
+    double previousEnergy = energy;
+    float change = global_step( positions );
+    energy = local_step( positions );
+
+    iterationEnergies.push_back( energy );
+    iterationChanges.push_back( change );
+    step ++;
+
+    stats.iterations = step;
+    stats.totalIterations ++;
+    stats.deformation.add( elapsed_ms( start ) );
+
+    const double convergence = tolerance > 0. ? tolerance : 1e-4;
+    return step > 1 && fabs( previousEnergy - energy ) <= convergence * previousEnergy && change <= convergence;
+}
+
+void AsRigidAsPossible::set_handle_positions(const std::vector<Vec3Df> & positions){
+
+    // the hard constraints are read from the positions by build_rhs
+    if( constraintMode == SOFT ){
+        int nb_found = 0;
+        for( unsigned int i = 0 ; i < vertices.size() ; i ++ ){
+            if( handles[i] ){
+                set_b_value( vertices.size() + nb_found, sumWij[i] * positions[i]);
+                nb_found++;
             }
+        }
+    }
+}
+
+void AsRigidAsPossible::compute_deformations(std::vector< std::vector<Vec3Df> > & frames){
 
-            set_b_value( i, p);
-            //    }
+    if( constrainedNb == 0 || frames.empty() ) {
+        return;
+    }
+
+    const int frameNb = frames.size();
+    const int workerNb = std::min( (int)threadNb, frameNb );
+
+    std::vector< AsRigidAsPossible * > workers( workerNb, this );
+    if( workerNb > 1 )
+        for( int w = 0 ; w < workerNb ; w++ )
+            workers[w] = create_frame_worker();
+
+#pragma omp parallel for num_threads(workerNb) schedule(static,1)
+    for( int w = 0 ; w < workerNb ; w++ ){
+        int begin = ( w * frameNb ) / workerNb, end = ( ( w + 1 ) * frameNb ) / workerNb;
+        for( int f = begin ; f < end ; f++ ){
+            if( f > begin ){
+                for( unsigned int i = 0 ; i < vertices.size() ; i ++ )
+                    if( !handles[i] ) frames[f][i] = frames[f-1][i];
+            }
+            workers[w]->compute_deformation( frames[f] );
         }
+    }
+
+    if( workerNb > 1 ){
+        for( int w = 0 ; w < workerNb ; w++ ){
+            const Stats & workerStats = workers[w]->stats;
+            PhaseTiming * phases[] = { &stats.deformation, &stats.rhs, &stats.solve, &stats.localStep };
+            const PhaseTiming * workerPhases[] = { &workerStats.deformation, &workerStats.rhs, &workerStats.solve, &workerStats.localStep };
+            for( int p = 0 ; p < 4 ; p++ ){
+                phases[p]->last = workerPhases[p]->last;
+                phases[p]->total += workerPhases[p]->total;
+                phases[p]->calls += workerPhases[p]->calls;
+            }
+            stats.iterations = workerStats.iterations;
+            stats.totalIterations += workerStats.totalIterations;
+            delete workers[w];
+        }
+    }
+}
+
+AsRigidAsPossible * AsRigidAsPossible::create_frame_worker(){
+
+    // same mesh, handles and settings, its own rotations, right hand side
+    // and solve workspaces, and one thread as the frames are the parallel loop
+    AsRigidAsPossible * worker = new AsRigidAsPossible();
+    worker->iterationNb = iterationNb;
+    worker->fineIterationNb = fineIterationNb;
+    worker->tolerance = tolerance;
+    worker->threadNb = 1;
+    worker->constraintMode = constraintMode;
+    worker->linearSolver = linearSolver;
+    worker->cgTolerance = cgTolerance;
+    worker->cgIterationNb = cgIterationNb;
+    worker->cgPreconditioner = cgPreconditioner;
+    worker->restScale = restScale;
+
+    worker->vertices = vertices;
+    worker->handles = handles;
+    worker->constrainedNb = constrainedNb;
+    worker->oneRingOffsets = oneRingOffsets;
+    worker->oneRingNeighbors = oneRingNeighbors;
+    worker->oneRingWeights = oneRingWeights;
+    worker->oneRingBij = oneRingBij;
+    worker->sumWij = sumWij;
+    worker->rotationClusterSize = rotationClusterSize;
+    worker->rotationClusterOffsets = rotationClusterOffsets;
+    worker->rotationClusterVertices = rotationClusterVertices;
+    worker->rotationClusters = rotationClusters;
+    worker->setDefaultRotations();
+    worker->R = R;
+    worker->setAndersonWindow( andersonWindow );
+
+    cholmod_start(&worker->_c);
+    worker->data_loaded = true;
+
+    worker->borrowedSystem = true;
+    worker->_Lap = _Lap;
+    worker->_L = _L;
+    worker->_cols = vertices.size();
+    worker->allocates_cholmod_b();
+    if( linearSolver == CONJUGATE_GRADIENT )
+        worker->compute_cg_preconditioner();
+
+    if( coarser != NULL ){
+        worker->coarser = coarser->create_frame_worker();
+        worker->levelNb = levelNb;
+        worker->fineToCoarse = fineToCoarse;
+        worker->coarseRepresentatives = coarseRepresentatives;
+        worker->coarseHandleCounts = coarseHandleCounts;
+        worker->coarsePositions = coarsePositions;
+    }
+
+    return worker;
+}
+
+float AsRigidAsPossible::global_step( std::vector<Vec3Df> & positions ){
 
+    build_rhs( positions );
+    return solve_positions( positions );
+}
+
+void AsRigidAsPossible::build_rhs( const std::vector<Vec3Df> & positions ){
 
-        cholmod_dense* x = solve_cholmod();
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    const int n = vertices.size();
+
+#pragma omp parallel for num_threads(threadNb) schedule(static)
+    for( int i = 0 ; i < n ; i ++ ){
+        //   if( !handles[i] ){
 
-        double * data = (double *)x->x;
-        for(unsigned int i = 0 ; i < vertices.size() ; i ++ ){
-            if ( !handles[i] ){
-                positions[i][0] = data[i + _cols*0];
-                positions[i][1] = data[i + _cols*1];
-                positions[i][2] = data[i + _cols*2];
+        Vec3Df p (0.,0.,0.);
+        double M[9];
+
+        for( unsigned int h = oneRingOffsets[i] ; h < oneRingOffsets[i+1] ; h++ ){
+            unsigned int j = oneRingNeighbors[h];
+
+            for( int k = 0 ; k < 9 ; k++ )
+                M[k] = (double)R[i].m[k] + R[j].m[k];
+            compute_product_and_sum( M, oneRingBij[h], p );
+        }
+
+        if( constraintMode == HARD ){
+            if( handles[i] ){
+                p = positions[i];
+            } else {
+                for( unsigned int h = oneRingOffsets[i] ; h < oneRingOffsets[i+1] ; h++ ){
+                    unsigned int j = oneRingNeighbors[h];
+                    if( handles[j] )
+                        p += oneRingWeights[h] * positions[j];
+                }
             }
         }
 
+        set_b_value( i, p);
+        //    }
+    }
 
-        for(unsigned int i = 0 ; i < vertices.size() ; i ++ ){
-            compute_S( S , i, positions );
-            singular_value_decomposition( S, U, V );
-            compute_R( R[i] , U, V );
+    stats.rhs.add( elapsed_ms( start ) );
+}
+
+float AsRigidAsPossible::solve_positions( std::vector<Vec3Df> & positions ){
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    const double * data = ( linearSolver == CONJUGATE_GRADIENT ) ?
+                solve_conjugate_gradient( positions ) : (double *)solve_cholmod()->x;
+
+    float change = 0.;
+    for(unsigned int i = 0 ; i < vertices.size() ; i ++ ){
+        if ( !handles[i] ){
+            Vec3Df p( data[i + _cols*0], data[i + _cols*1], data[i + _cols*2] );
+            change = std::max( change, ( p - positions[i] ).getSquaredLength() );
+            positions[i] = p;
         }
-        step ++;
     }
-    //compute_guess()
-    
-    gsl_matrix_free( M );
-    gsl_matrix_free( S );
 
-    gsl_matrix_free( U );
-    gsl_matrix_free( V );
+    stats.solve.add( elapsed_ms( start ) );
+    return sqrt( change ) / restScale;
+}
+
+double AsRigidAsPossible::local_step( const std::vector<Vec3Df> & positions ){
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    const int n = vertices.size();
+    const int chunkNb = ( n + ROTATION_FITTING_CHUNK - 1 ) / ROTATION_FITTING_CHUNK;
+
+    // with rotation clusters, localS and localR hold the m covariances and
+    // rotations of the clusters
+    const bool clustered = !rotationClusterOffsets.empty();
+    const int m = clustered ? rotationClusterOffsets.size() - 1 : n;
+    const int clusterChunkNb = ( m + ROTATION_FITTING_CHUNK - 1 ) / ROTATION_FITTING_CHUNK;
+
+#pragma omp parallel num_threads(threadNb)
+    {
+        if( clustered ){
+#pragma omp for schedule(static)
+            for( int c = 0 ; c < m ; c ++ ){
+                double S[9], clusterS[9] = { 0., 0., 0., 0., 0., 0., 0., 0., 0. };
+                for( unsigned int v = rotationClusterOffsets[c] ; v < rotationClusterOffsets[c+1] ; v++ ){
+                    compute_S( S , rotationClusterVertices[v], positions );
+                    for( int k = 0 ; k < 9 ; k++ )
+                        clusterS[k] += S[k];
+                }
+                for( int k = 0 ; k < 9 ; k++ )
+                    localS[k*m + c] = clusterS[k];
+            }
+
+#pragma omp for schedule(static)
+            for( int c = 0 ; c < clusterChunkNb ; c ++ ){
+                int begin = c * ROTATION_FITTING_CHUNK;
+                int count = std::min( m - begin, ROTATION_FITTING_CHUNK );
+                RotationFitting::closestRotations( &localS[begin], &localR[begin], count, m );
+            }
+        } else {
+#pragma omp for schedule(static)
+            for( int i = 0 ; i < n ; i ++ ){
+                double S[9];
+                compute_S( S , i, positions );
+                for( int k = 0 ; k < 9 ; k++ )
+                    localS[k*n + i] = S[k];
+            }
+        }
 
+        // the energy is summed by chunks in a fixed order, so that it does
+        // not depend on the number of threads either
+#pragma omp for schedule(static)
+        for( int c = 0 ; c < chunkNb ; c ++ ){
+            int begin = c * ROTATION_FITTING_CHUNK;
+            int count = std::min( n - begin, ROTATION_FITTING_CHUNK );
+            if( !clustered )
+                RotationFitting::closestRotations( &localS[begin], &localR[begin], count, n );
+
+            double chunkEnergy = 0.;
+            for( int i = begin ; i < begin + count ; i ++ ){
+                int r = clustered ? rotationClusters[i] : i;
+                for( int k = 0 ; k < 9 ; k++ )
+                    R[i].m[k] = localR[k*m + r];
+                chunkEnergy += compute_energy( i, positions );
+            }
+            chunkEnergies[c] = chunkEnergy;
+        }
+    }
+
+    double e = 0.;
+    for( int c = 0 ; c < chunkNb ; c ++ )
+        e += chunkEnergies[c];
+
+    stats.localStep.add( elapsed_ms( start ) );
+    return e;
 }
 
-void AsRigidAsPossible::compute_product_and_sum( gsl_matrix * R, const Vec3Df & point, Vec3Df & result ){
+void AsRigidAsPossible::setAndersonWindow( unsigned int m ){
+
+    andersonWindow = m;
+
+    unsigned int size = 3 * vertices.size();
+    anderson.x.resize( m > 0 ? size : 0 );
+    anderson.g.resize( m > 0 ? size : 0 );
+    anderson.f.resize( m > 0 ? size : 0 );
+    anderson.previousG.resize( m > 0 ? size : 0 );
+    anderson.previousF.resize( m > 0 ? size : 0 );
+    anderson.dG.resize( m * size );
+    anderson.dF.resize( m * size );
+    anderson.gram.resize( m * m );
+    anderson.theta.resize( m );
+    anderson.system.resize( m * ( m + 1 ) );
+    anderson_reset();
+}
 
-    result[0] += point[0]*gsl_matrix_get( R, 0 , 0 ) + point[1]*gsl_matrix_get( R, 0 , 1 )+ point[2]*gsl_matrix_get( R, 0 , 2 );
-    result[1] += point[0]*gsl_matrix_get( R, 1 , 0 ) + point[1]*gsl_matrix_get( R, 1 , 1 )+ point[2]*gsl_matrix_get( R, 1 , 2 );
-    result[2] += point[0]*gsl_matrix_get( R, 2 , 0 ) + point[1]*gsl_matrix_get( R, 2 , 1 )+ point[2]*gsl_matrix_get( R, 2 , 2 );
+void AsRigidAsPossible::anderson_reset(){
+    anderson.count = 0;
+    anderson.column = 0;
+    anderson.hasPrevious = false;
+}
 
+void AsRigidAsPossible::anderson_store( const std::vector<Vec3Df> & positions, std::vector<double> & x ){
+    for( unsigned int i = 0 ; i < positions.size() ; i ++ )
+        for( int k = 0 ; k < 3 ; k++ )
+            x[3*i + k] = positions[i][k];
 }
 
-void AsRigidAsPossible::compute_S( gsl_matrix * S , unsigned int vi, const std::vector<Vec3Df> & verticesp){
+void AsRigidAsPossible::anderson_restore( const std::vector<double> & x, std::vector<Vec3Df> & positions ){
+    for( unsigned int i = 0 ; i < positions.size() ; i ++ )
+        if( !handles[i] )
+            positions[i] = Vec3Df( x[3*i], x[3*i + 1], x[3*i + 2] );
+}
 
-    std::vector<unsigned int> & Ni = oneRing[vi];
+bool AsRigidAsPossible::anderson_step( std::vector<Vec3Df> & positions ){
 
-    gsl_matrix_set_zero ( S );
-    
-    for (unsigned int j = 0; j < Ni.size(); j++){
-        Vec3Df eij = vertices[Ni[j]] -vertices[vi];
-        Vec3Df eijp = verticesp[Ni[j]] -verticesp[vi];
+    const unsigned int size = 3 * vertices.size();
+    const unsigned int m = andersonWindow;
 
-        Edge e ( vi , Ni[j] );
-        float wij = edgesWeightMap[e];
+    // g = G(x) is the plain local-global step from x, f = g - x its residual
+    anderson_store( positions, anderson.g );
+    for( unsigned int k = 0 ; k < size ; k++ )
+        anderson.f[k] = anderson.g[k] - anderson.x[k];
 
-        for( int k = 0 ; k < 3  ; ++k )
-            for( int l = 0 ; l < 3 ; ++l )
-                gsl_matrix_set(S, k , l , gsl_matrix_get(S,k,l) + wij * eij[k] * eijp[l] );
+    if( anderson.hasPrevious ){
+        unsigned int c = anderson.column;
+        double * dG = &anderson.dG[c * size];
+        double * dF = &anderson.dF[c * size];
+        for( unsigned int k = 0 ; k < size ; k++ ){
+            dG[k] = anderson.g[k] - anderson.previousG[k];
+            dF[k] = anderson.f[k] - anderson.previousF[k];
+        }
+        anderson.count = std::min( anderson.count + 1, m );
+        anderson.column = ( c + 1 ) % m;
+
+        // dF^T dF, updated for the new column only
+        for( unsigned int j = 0 ; j < anderson.count ; j++ ){
+            const double * dFj = &anderson.dF[j * size];
+            double d = 0.;
+            for( unsigned int k = 0 ; k < size ; k++ )
+                d += dF[k] * dFj[k];
+            anderson.gram[c * m + j] = anderson.gram[j * m + c] = d;
+        }
+    }
+
+    anderson.previousG.swap( anderson.g );
+    anderson.previousF.swap( anderson.f );
+    anderson.hasPrevious = true;
+
+    const unsigned int count = anderson.count;
+    if( count == 0 )
+        return false;
+
+    // theta = argmin | f - dF theta | from the normal equations (Gaussian
+    // elimination with partial pivoting on the small count x count system,
+    // slightly regularized), f and g being in previousF / previousG now
+    const unsigned int w = count + 1;
+    double * A = &anderson.system[0];
+    double trace = 0.;
+    for( unsigned int i = 0 ; i < count ; i++ )
+        trace += anderson.gram[i * m + i];
+    for( unsigned int i = 0 ; i < count ; i++ ){
+        for( unsigned int j = 0 ; j < count ; j++ )
+            A[i * w + j] = anderson.gram[i * m + j];
+        A[i * w + i] += 1e-10 * trace + std::numeric_limits<double>::min();
+
+        const double * dFi = &anderson.dF[i * size];
+        double d = 0.;
+        for( unsigned int k = 0 ; k < size ; k++ )
+            d += dFi[k] * anderson.previousF[k];
+        A[i * w + count] = d;
+    }
+
+    for( unsigned int col = 0 ; col < count ; col++ ){
+        unsigned int pivot = col;
+        for( unsigned int i = col + 1 ; i < count ; i++ )
+            if( fabs( A[i * w + col] ) > fabs( A[pivot * w + col] ) )
+                pivot = i;
+        if( A[pivot * w + col] == 0. )
+            return false;
+        for( unsigned int j = 0 ; j < w ; j++ )
+            std::swap( A[col * w + j], A[pivot * w + j] );
+        for( unsigned int i = col + 1 ; i < count ; i++ ){
+            double factor = A[i * w + col] / A[col * w + col];
+            for( unsigned int j = col ; j < w ; j++ )
+                A[i * w + j] -= factor * A[col * w + j];
+        }
     }
+    for( unsigned int i = count ; i-- > 0 ; ){
+        double t = A[i * w + count];
+        for( unsigned int j = i + 1 ; j < count ; j++ )
+            t -= A[i * w + j] * anderson.theta[j];
+        anderson.theta[i] = t / A[i * w + i];
+    }
+
+    // accelerated positions g - dG theta, the plain step g is kept for the safeguard
+    anderson.g = anderson.previousG;
+    for( unsigned int i = 0 ; i < vertices.size() ; i ++ ){
+        if( handles[i] ) continue;
+        for( int k = 0 ; k < 3 ; k++ ){
+            double p = anderson.g[3*i + k];
+            for( unsigned int j = 0 ; j < count ; j++ )
+                p -= anderson.theta[j] * anderson.dG[j * size + 3*i + k];
+            positions[i][k] = p;
+        }
+    }
+
+    return true;
 }
 
+double AsRigidAsPossible::compute_energy( unsigned int vi, const std::vector<Vec3Df> & verticesp){
 
-void AsRigidAsPossible::singular_value_decomposition( gsl_matrix * matrix, gsl_matrix * U, gsl_matrix * V ){
+    double e = 0.;
+    const float * Ri = R[vi].m;
 
-    gsl_vector * s = gsl_vector_alloc(3), * work= gsl_vector_alloc(3);
+    for (unsigned int h = oneRingOffsets[vi]; h < oneRingOffsets[vi+1]; h++){
+        unsigned int j = oneRingNeighbors[h];
+        Vec3Df eij = vertices[j] -vertices[vi];
+        Vec3Df eijp = verticesp[j] -verticesp[vi];
 
-    gsl_matrix_memcpy( U, matrix );
-    gsl_linalg_SV_decomp (U, V, s, work);
+        double d[3];
+        for( int k = 0 ; k < 3 ; k++ )
+            d[k] = eijp[k] - ( Ri[3*k] * eij[0] + Ri[3*k + 1] * eij[1] + Ri[3*k + 2] * eij[2] );
 
-    gsl_vector_free(s);
-    gsl_vector_free(work);
-    
+        e += oneRingWeights[h] * ( d[0] * d[0] + d[1] * d[1] + d[2] * d[2] );
+    }
+
+    return e;
 }
 
+void AsRigidAsPossible::compute_product_and_sum( const double * M, const Vec3Df & point, Vec3Df & result ){
 
-void AsRigidAsPossible::compute_R( gsl_matrix * R , gsl_matrix * U, gsl_matrix * V ){
-    
-    
-    gsl_matrix * C = gsl_matrix_alloc ( 3, 3 );
-    gsl_blas_dgemm( CblasNoTrans, CblasTrans, 1.0, V, U, 0.0, C );
-    
-    float det = compute_determinant(C);
-    if(det < 0.)
-        det = -1.;
-    else
-        det = 1.;
-    
-    gsl_matrix_set_identity (C);
-    gsl_matrix_set( C, 2, 2, det );
-    
-    gsl_matrix * T = gsl_matrix_alloc ( 3, 3 );
-    gsl_blas_dgemm( CblasNoTrans, CblasTrans, 1.0, C, U, 0.0, T );
-    
-    gsl_blas_dgemm( CblasNoTrans, CblasNoTrans, 1.0, V, T, 0.0, R );
-    
-    gsl_matrix_free(C);
-    gsl_matrix_free(T);
+    result[0] += point[0]*M[0] + point[1]*M[1] + point[2]*M[2];
+    result[1] += point[0]*M[3] + point[1]*M[4] + point[2]*M[5];
+    result[2] += point[0]*M[6] + point[1]*M[7] + point[2]*M[8];
 
 }
 
-float AsRigidAsPossible::compute_determinant( gsl_matrix * M ){
-    float a = gsl_matrix_get( M, 0, 0); float b = gsl_matrix_get( M, 0, 1); float c = gsl_matrix_get( M, 0, 2);
-    float d = gsl_matrix_get( M, 1, 0); float e = gsl_matrix_get( M, 1, 1); float f = gsl_matrix_get( M, 1, 2);
-    float g = gsl_matrix_get( M, 2, 0); float h = gsl_matrix_get( M, 2, 1); float i = gsl_matrix_get( M, 2, 2);
+void AsRigidAsPossible::compute_S( double * S , unsigned int vi, const std::vector<Vec3Df> & verticesp){
+
+    for( int k = 0 ; k < 9 ; k++ )
+        S[k] = 0.;
     
-    return a*(e*i - h*f) + b*(g*f - d*i) + c*(d*h - g*e);
+    for (unsigned int h = oneRingOffsets[vi]; h < oneRingOffsets[vi+1]; h++){
+        unsigned int j = oneRingNeighbors[h];
+        Vec3Df eij = vertices[j] -vertices[vi];
+        Vec3Df eijp = verticesp[j] -verticesp[vi];
+
+        float wij = oneRingWeights[h];
+
+        for( int k = 0 ; k < 3  ; ++k )
+            for( int l = 0 ; l < 3 ; ++l )
+                S[3*k + l] += wij * eij[k] * eijp[l];
+    }
 }
 
-void AsRigidAsPossible::factorize_cholmod_A_system()
+
+bool AsRigidAsPossible::factorize_cholmod_A_system()
 {
-    cholmod_print_triplet (_triplet, "triplet", &_c);
-    cholmod_sparse* A   = cholmod_triplet_to_sparse(_triplet, _triplet->nnz, &_c);
-    
-    _At  = cholmod_transpose(A, 1, &_c);
-    
-    cholmod_sparse* AtA = cholmod_ssmult(_At, A, 0, 1, 1, &_c);
-    AtA->stype = 1;
-    
-    _L = cholmod_analyze(AtA, &_c);
-    
-    cholmod_factorize(AtA, _L, &_c);
+    // back to the analyzed supernodal factor after low-rank updates
+    if( _superL != NULL ){
+        cholmod_free_factor(&_L, &_c);
+        _L = _superL;
+        _superL = NULL;
+    }
+
+    // numeric factorization only, the symbolic analysis is kept in _L
+    return cholmod_factorize(_A, _L, &_c) && _c.status == CHOLMOD_OK;
 }
 
 
@@ -379,12 +1254,6 @@ void AsRigidAsPossible::add_A_coeff( const int row , const int col , const doubl
     _triplet->nnz++;
 }
 
-void AsRigidAsPossible::update_A_coeff( const int i , const double value )
-{
-    _valuePtrA[i] = value;
-    // DANGEREUX , ne faire que si on connait parfaitement la structure de la matrice (ce qui est le cas ici, si on se debrouille bien ...)
-}
-
 void AsRigidAsPossible::set_b_value( const int i , const Vec3Df & value )
 {
     _valuePtrB[i + 0 * _rows] = value[0];
@@ -394,115 +1263,737 @@ void AsRigidAsPossible::set_b_value( const int i , const Vec3Df & value )
 
 cholmod_dense* AsRigidAsPossible::solve_cholmod()
 {
-    cholmod_dense* x;
+    // _x and the cholmod_solve2 workspaces _Y and _E are allocated by the
+    // first solve and reused by the next ones
+    if( constraintMode == HARD ){
+        cholmod_solve2(CHOLMOD_A, _L, _b, NULL, &_x, NULL, &_Y, &_E, &_c);
+        return _x;
+    }
+
     double alpha[] = {1, 1};
     double beta[] = {0, 0};
+
+    // At b = Lap^T b on the first _cols rows, plus sumWij times the handle rows
+    cholmod_dense bLap = *_b;
+    bLap.nrow = _cols;
+    cholmod_sdmult(_Lap, 1, alpha, beta, &bLap, _Atb, &_c);
+
+    double * valuePtrAtb = (double*)_Atb->x;
+    int nb_found = 0;
+    for( int i = 0 ; i < _cols ; i++ ){
+        if( handles[i] ){
+            for( int k = 0 ; k < 3 ; k++ )
+                valuePtrAtb[i + k * _Atb->d] += sumWij[i] * _valuePtrB[_cols + nb_found + k * _rows];
+            nb_found++;
+        }
+    }
     
-    cholmod_dense* Atb = cholmod_allocate_dense(_cols, 3, 3 * _cols, CHOLMOD_REAL, &_c);
-    
-    cholmod_sdmult(_At, 0, alpha, beta, _b, Atb, &_c);
-    
-    x = cholmod_solve(CHOLMOD_A, _L, Atb, &_c);
-    
-    cholmod_free_dense(&Atb, &_c);
+    cholmod_solve2(CHOLMOD_A, _L, _Atb, NULL, &_x, NULL, &_Y, &_E, &_c);
     
+    return _x;
+}
+
+void AsRigidAsPossible::compute_cg_preconditioner()
+{
+    const unsigned int n = vertices.size();
+    cgX.resize( 3 * n ); cgR.resize( 3 * n ); cgZ.resize( 3 * n );
+    cgP.resize( 3 * n ); cgQ.resize( 3 * n ); cgB.resize( 3 * n );
+    cgT.resize( constraintMode == SOFT ? 3 * n : 0 );
+    cgPartialDots.resize( 3 * ( ( n + CONJUGATE_GRADIENT_CHUNK - 1 ) / CONJUGATE_GRADIENT_CHUNK ) );
+
+    // HARD : diagonal of the Laplacian, 1 on the handles
+    // SOFT : diagonal of Lap^T Lap, sumWij^2 more on the handles
+    cgInverseDiagonal.resize( n );
+    for( unsigned int i = 0 ; i < n ; i ++ ){
+        double d;
+        if( constraintMode == HARD ){
+            d = handles[i] ? 1. : sumWij[i];
+        } else {
+            d = (double)sumWij[i] * sumWij[i];
+            for( unsigned int h = oneRingOffsets[i] ; h < oneRingOffsets[i+1] ; h++ )
+                d += (double)oneRingWeights[h] * oneRingWeights[h];
+            if( handles[i] )
+                d += (double)sumWij[i] * sumWij[i];
+        }
+        cgInverseDiagonal[i] = d > 0. ? 1. / d : 1.;
+    }
+
+    icOffsets.clear(); icColumns.clear(); icValues.clear(); icSystem.clear();
+    stats.nnzL = 0;
+    stats.factorBytes = 0;
+    if( cgPreconditioner != INCOMPLETE_CHOLESKY )
+        return;
+
+    // lower part of the system, row by row
+    std::vector<double> row( n, 0. );
+    std::vector<unsigned int> columns;
+    icOffsets.push_back( 0 );
+    for( unsigned int i = 0 ; i < n ; i ++ ){
+        columns.clear();
+        if( constraintMode == HARD ){
+            columns.push_back( i );
+            row[i] = handles[i] ? 1. : sumWij[i];
+            for( unsigned int h = oneRingOffsets[i] ; h < oneRingOffsets[i+1] && !handles[i] ; h++ ){
+                unsigned int j = oneRingNeighbors[h];
+                if( j < i && !handles[j] ){
+                    columns.push_back( j );
+                    row[j] = -oneRingWeights[h];
+                }
+            }
+        } else {
+            // (Lap Lap)_ij = sum_k Lap_ik Lap_kj over k in the one-ring of i and i itself
+            for( unsigned int h = oneRingOffsets[i] ; h <= oneRingOffsets[i+1] ; h++ ){
+                unsigned int k = h < oneRingOffsets[i+1] ? oneRingNeighbors[h] : i;
+                double lik = h < oneRingOffsets[i+1] ? -oneRingWeights[h] : sumWij[i];
+                for( unsigned int g = oneRingOffsets[k] ; g <= oneRingOffsets[k+1] ; g++ ){
+                    unsigned int j = g < oneRingOffsets[k+1] ? oneRingNeighbors[g] : k;
+                    double lkj = g < oneRingOffsets[k+1] ? -oneRingWeights[g] : sumWij[k];
+                    if( j > i ) continue;
+                    if( std::find( columns.begin(), columns.end(), j ) == columns.end() )
+                        columns.push_back( j );
+                    row[j] += lik * lkj;
+                }
+            }
+            if( handles[i] )
+                row[i] += (double)sumWij[i] * sumWij[i];
+        }
+
+        std::sort( columns.begin(), columns.end() );
+        for( unsigned int c = 0 ; c < columns.size() ; c++ ){
+            icColumns.push_back( columns[c] );
+            icSystem.push_back( row[columns[c]] );
+            row[columns[c]] = 0.;
+        }
+        icOffsets.push_back( icColumns.size() );
+    }
+
+    // the cotangent Laplacian is not always an M-matrix : on a breakdown the
+    // diagonal is increased, up to doubling it, then Jacobi is used instead
+    const double shifts[] = { 0., 1e-3, 1e-2, 1e-1, 1. };
+    const unsigned int shiftNb = sizeof( shifts ) / sizeof( shifts[0] );
+    unsigned int attempt = 0;
+    while( attempt < shiftNb && !compute_incomplete_cholesky( shifts[attempt] ) )
+        attempt++;
+    if( attempt == shiftNb ){
+        std::cout << "AsRigidAsPossible::compute_cg_preconditioner::incomplete Cholesky factorization failed, using Jacobi" << std::endl;
+        icOffsets.clear(); icColumns.clear(); icValues.clear(); icSystem.clear();
+        return;
+    }
+
+    stats.nnzL = icValues.size();
+    stats.factorBytes = icOffsets.size() * sizeof( unsigned int ) +
+            icColumns.size() * ( sizeof( unsigned int ) + sizeof( double ) );
+}
+
+bool AsRigidAsPossible::compute_incomplete_cholesky( double shift )
+{
+    // L_ij = ( A_ij - sum_k<j L_ik L_jk ) / L_jj on the pattern of A only,
+    // L_ii = sqrt( ( 1 + shift ) A_ii - sum_k<i L_ik^2 ), or 1 as in Jacobi
+    // when A_ii is not positive (unreferenced vertex, obtuse one-ring)
+    const unsigned int n = vertices.size();
+    icValues = icSystem;
+    for( unsigned int i = 0 ; i < n ; i ++ ){
+        const unsigned int diagonal = icOffsets[i+1] - 1;
+        for( unsigned int p = icOffsets[i] ; p <= diagonal ; p++ ){
+            const unsigned int j = icColumns[p];
+            const unsigned int jDiagonal = icOffsets[j+1] - 1;
+            double s = icValues[p];
+            unsigned int a = icOffsets[i], b = icOffsets[j];
+            while( a < p && b < jDiagonal ){
+                if( icColumns[a] < icColumns[b] ) a++;
+                else if( icColumns[b] < icColumns[a] ) b++;
+                else s -= icValues[a++] * icValues[b++];
+            }
+            if( p < diagonal ){
+                icValues[p] = s / icValues[jDiagonal];
+            } else {
+                if( icSystem[p] > 0. )
+                    s += shift * icSystem[p];
+                else
+                    s = 1.;
+                if( !( s > 0. ) )
+                    return false;
+                icValues[p] = sqrt( s );
+            }
+        }
+    }
+    return true;
+}
+
+void AsRigidAsPossible::apply_cg_preconditioner( const double * r , double * z )
+{
+    const int n = vertices.size();
+
+    if( cgPreconditioner != INCOMPLETE_CHOLESKY || icOffsets.empty() ){
+#pragma omp parallel for num_threads(threadNb) schedule(static)
+        for( int i = 0 ; i < n ; i ++ )
+            for( int k = 0 ; k < 3 ; k++ )
+                z[k*n + i] = cgInverseDiagonal[i] * r[k*n + i];
+        return;
+    }
+
+    // z = (L L^T)^-1 r, the triangular solves of a coordinate are sequential
+#pragma omp parallel for num_threads(std::min(threadNb, 3u)) schedule(static)
+    for( int k = 0 ; k < 3 ; k++ ){
+        const double * rk = r + k*n;
+        double * zk = z + k*n;
+        for( int i = 0 ; i < n ; i ++ ){
+            const unsigned int diagonal = icOffsets[i+1] - 1;
+            double s = rk[i];
+            for( unsigned int p = icOffsets[i] ; p < diagonal ; p++ )
+                s -= icValues[p] * zk[icColumns[p]];
+            zk[i] = s / icValues[diagonal];
+        }
+        for( int i = n - 1 ; i >= 0 ; i -- ){
+            const unsigned int diagonal = icOffsets[i+1] - 1;
+            zk[i] /= icValues[diagonal];
+            for( unsigned int p = icOffsets[i] ; p < diagonal ; p++ )
+                zk[icColumns[p]] -= icValues[p] * zk[i];
+        }
+    }
+}
+
+void AsRigidAsPossible::apply_laplacian( const double * x , double * y , bool restricted )
+{
+    // y = Lap x, or with the handles eliminated (identity rows and no
+    // coupling to the handles) when restricted
+    const int n = vertices.size();
+
+#pragma omp parallel for num_threads(threadNb) schedule(static)
+    for( int i = 0 ; i < n ; i ++ ){
+        if( restricted && handles[i] ){
+            for( int k = 0 ; k < 3 ; k++ )
+                y[k*n + i] = x[k*n + i];
+            continue;
+        }
+
+        double s[3];
+        for( int k = 0 ; k < 3 ; k++ )
+            s[k] = sumWij[i] * x[k*n + i];
+        for( unsigned int h = oneRingOffsets[i] ; h < oneRingOffsets[i+1] ; h++ ){
+            unsigned int j = oneRingNeighbors[h];
+            if( restricted && handles[j] ) continue;
+            for( int k = 0 ; k < 3 ; k++ )
+                s[k] -= oneRingWeights[h] * x[k*n + j];
+        }
+        for( int k = 0 ; k < 3 ; k++ )
+            y[k*n + i] = s[k];
+    }
+}
+
+void AsRigidAsPossible::apply_cg_system( const double * x , double * y )
+{
+    if( constraintMode == HARD ){
+        apply_laplacian( x, y, true );
+        return;
+    }
+
+    // Lap^T Lap x (the Laplacian is symmetric) + sumWij^2 x on the handles
+    const int n = vertices.size();
+    apply_laplacian( x, &cgT[0], false );
+    apply_laplacian( &cgT[0], y, false );
+
+#pragma omp parallel for num_threads(threadNb) schedule(static)
+    for( int i = 0 ; i < n ; i ++ )
+        if( handles[i] )
+            for( int k = 0 ; k < 3 ; k++ )
+                y[k*n + i] += (double)sumWij[i] * sumWij[i] * x[k*n + i];
+}
+
+void AsRigidAsPossible::cg_dot( const double * a , const double * b , double * dots )
+{
+    // summed by chunks in a fixed order, so that the iterates do not depend
+    // on the number of threads
+    const int n = vertices.size();
+    const int chunkNb = ( n + CONJUGATE_GRADIENT_CHUNK - 1 ) / CONJUGATE_GRADIENT_CHUNK;
+
+#pragma omp parallel for num_threads(threadNb) schedule(static)
+    for( int c = 0 ; c < chunkNb ; c ++ ){
+        int begin = c * CONJUGATE_GRADIENT_CHUNK;
+        int end = std::min( n, begin + CONJUGATE_GRADIENT_CHUNK );
+        for( int k = 0 ; k < 3 ; k++ ){
+            double d = 0.;
+            for( int i = begin ; i < end ; i ++ )
+                d += a[k*n + i] * b[k*n + i];
+            cgPartialDots[3*c + k] = d;
+        }
+    }
+
+    for( int k = 0 ; k < 3 ; k++ ){
+        dots[k] = 0.;
+        for( int c = 0 ; c < chunkNb ; c ++ )
+            dots[k] += cgPartialDots[3*c + k];
+    }
+}
+
+const double * AsRigidAsPossible::solve_conjugate_gradient( const std::vector<Vec3Df> & positions )
+{
+    const int n = vertices.size();
+    double * x = &cgX[0], * r = &cgR[0], * z = &cgZ[0], * p = &cgP[0], * q = &cgQ[0], * b = &cgB[0];
+
+    // right hand side, as in solve_cholmod
+    if( constraintMode == HARD ){
+        for( int k = 0 ; k < 3 ; k++ )
+            std::copy( _valuePtrB + k * _rows, _valuePtrB + k * _rows + n, b + k * n );
+    } else {
+        for( int k = 0 ; k < 3 ; k++ )
+            std::copy( _valuePtrB + k * _rows, _valuePtrB + k * _rows + n, &cgT[k * n] );
+        apply_laplacian( &cgT[0], b, false );
+        int nb_found = 0;
+        for( int i = 0 ; i < n ; i++ ){
+            if( handles[i] ){
+                for( int k = 0 ; k < 3 ; k++ )
+                    b[k*n + i] += sumWij[i] * _valuePtrB[n + nb_found + k * _rows];
+                nb_found++;
+            }
+        }
+    }
+
+    // warm start from the current positions
+    for( int i = 0 ; i < n ; i ++ )
+        for( int k = 0 ; k < 3 ; k++ )
+            x[k*n + i] = positions[i][k];
+
+    // the tolerance is relative to the right hand side of the free vertices,
+    // the handle rows being much larger and trivially satisfied
+    double bb[3], rr[3], rz[3], pq[3], rzNext[3];
+    bool converged[3];
+    for( int k = 0 ; k < 3 * n ; k ++ )
+        z[k] = handles[k % n] ? 0. : b[k];
+    cg_dot( z, z, bb );
+
+    apply_cg_system( x, q );
+    for( int k = 0 ; k < 3 * n ; k ++ )
+        r[k] = b[k] - q[k];
+    apply_cg_preconditioner( r, z );
+    std::copy( z, z + 3 * n, p );
+
+    cg_dot( r, r, rr );
+    cg_dot( r, z, rz );
+
+    unsigned int it = 0;
+    for( ; ; ){
+        bool done = true;
+        for( int k = 0 ; k < 3 ; k++ ){
+            converged[k] = rr[k] <= cgTolerance * cgTolerance * bb[k];
+            done = done && converged[k];
+        }
+        if( done || it == cgIterationNb )
+            break;
+
+        apply_cg_system( p, q );
+        cg_dot( p, q, pq );
+
+        double alpha[3];
+        for( int k = 0 ; k < 3 ; k++ )
+            alpha[k] = ( converged[k] || pq[k] <= 0. ) ? 0. : rz[k] / pq[k];
+
+#pragma omp parallel for num_threads(threadNb) schedule(static)
+        for( int i = 0 ; i < n ; i ++ ){
+            for( int k = 0 ; k < 3 ; k++ ){
+                x[k*n + i] += alpha[k] * p[k*n + i];
+                r[k*n + i] -= alpha[k] * q[k*n + i];
+            }
+        }
+        apply_cg_preconditioner( r, z );
+
+        cg_dot( r, r, rr );
+        cg_dot( r, z, rzNext );
+
+        double beta[3];
+        for( int k = 0 ; k < 3 ; k++ ){
+            beta[k] = rz[k] > 0. ? rzNext[k] / rz[k] : 0.;
+            rz[k] = rzNext[k];
+        }
+
+#pragma omp parallel for num_threads(threadNb) schedule(static)
+        for( int i = 0 ; i < n ; i ++ )
+            for( int k = 0 ; k < 3 ; k++ )
+                p[k*n + i] = z[k*n + i] + beta[k] * p[k*n + i];
+
+        it++;
+    }
+
+    cgIterationsUsed += it;
     return x;
 }
 
+// Position of the coefficient (row,col) in the values of a packed and sorted matrix
+static int find_sparse_entry( cholmod_sparse * A , int row , int col ){
+    int * Ap = (int*)A->p;
+    int * Ai = (int*)A->i;
+    int * it = std::lower_bound( Ai + Ap[col], Ai + Ap[col+1], row );
+    return it - Ai;
+}
 
-void AsRigidAsPossible::allocates_cholmod_A_and_b(  )
+bool AsRigidAsPossible::analyze_cholmod_A_system(  )
 {
-    // POUR PARAMETRER LE SOLVEUR :
-    // Vous devez dire au moment de l'allocation (dans les lignes suivantes) le nombre d'equations que vous allez ajouter dans la matrice A,
-    // ainsi que le nombre de valeurs non nulles que chaque terme d'energie implique dans la matrice A.
-    //
-    // Vous devez donc changer les lignes ci dessous , dans la partie ALLOCATION de la PARAMETRISATION du solveur, ainsi qu'ajouter les termes
-    // dans le solveur dans la fonction fill_cholmod_A_and_b() , ou vous devrez mettre en face les equations implicites dans A et le terme de droite
-    // dans b.
-    
-    
-    // 1) PARAMETRISATION SOLVEUR , PARTIE ALLOCATION :
-    
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
     _cols = vertices.size();
-    _rows = _cols + constrainedNb;
-    
-    _nb_non_zeros_in_A = _cols;
-    for( unsigned int i = 0 ; i < oneRing.size(); i++ ){
-        //  if( !handles[i] )
-        _nb_non_zeros_in_A += oneRing[i].size();
+    unsigned int halfEdgesNb = oneRingOffsets[vertices.size()];
+
+    if( constraintMode == SOFT ){
+        // Cotangent Laplacian, kept for the right hand sides Lap^T b
+        _nb_non_zeros_in_A = _cols + halfEdgesNb;
+        _triplet = cholmod_allocate_triplet( _cols , _cols , _nb_non_zeros_in_A, 0, CHOLMOD_REAL, &_c);
+        _rowPtrA = (int*)_triplet->i;
+        _colPtrA = (int*)_triplet->j;
+        _valuePtrA = (double*)_triplet->x;
+
+        for( unsigned int i = 0; i < vertices.size() ; i++ ){
+            for( unsigned int h = oneRingOffsets[i]; h < oneRingOffsets[i+1] ; h++ )
+                add_A_coeff( i, oneRingNeighbors[h], -oneRingWeights[h] );
+            add_A_coeff( i, i, sumWij[i] );
+        }
+
+        _Lap = cholmod_triplet_to_sparse(_triplet, _triplet->nnz, &_c);
+        cholmod_free_triplet(&_triplet, &_c);
+
+        cholmod_sparse* LapT = cholmod_transpose(_Lap, 1, &_c);
+        _A = cholmod_ssmult(LapT, _Lap, 1, 1, 1, &_c);
+        cholmod_free_sparse(&LapT, &_c);
+    } else {
+        // upper part of the Laplacian, the couplings with the handles are
+        // explicit zeros so that the pattern holds for any handle set
+        _nb_non_zeros_in_A = _cols + halfEdgesNb/2;
+        _triplet = cholmod_allocate_triplet( _cols , _cols , _nb_non_zeros_in_A, 1, CHOLMOD_REAL, &_c);
+        _rowPtrA = (int*)_triplet->i;
+        _colPtrA = (int*)_triplet->j;
+        _valuePtrA = (double*)_triplet->x;
+
+        for( unsigned int i = 0; i < vertices.size() ; i++ ){
+            for( unsigned int h = oneRingOffsets[i]; h < oneRingOffsets[i+1] ; h++ )
+                if( i < oneRingNeighbors[h] )
+                    add_A_coeff( i, oneRingNeighbors[h], 0. );
+            add_A_coeff( i, i, 0. );
+        }
+
+        _A = cholmod_triplet_to_sparse(_triplet, _triplet->nnz, &_c);
+        cholmod_free_triplet(&_triplet, &_c);
+
+        _upperIndex.resize( halfEdgesNb );
+        for( unsigned int i = 0; i < vertices.size() ; i++ ){
+            for( unsigned int h = oneRingOffsets[i]; h < oneRingOffsets[i+1] ; h++ ){
+                unsigned int j = oneRingNeighbors[h];
+                _upperIndex[h] = find_sparse_entry( _A, std::min( i, j ), std::max( i, j ) );
+            }
+        }
     }
 
-    _nb_non_zeros_in_A += constrainedNb;
-    
-    // std::cout << _rows << " lines " << _cols << " colones " << _nb_non_zeros_in_A << " non zero " << std::endl;
-    // FIN DE LA PARTIE ALLOCATION DE LA PARAMETRISATION DU SOLVEUR , ne touchez a rien d'autre en dessous ,
-    // allez voir directement dans la fonction fill_cholmod_A_and_b()
-    
-    
-    
-    // X etant l'inconnue du least squares system
-    
-    _triplet = cholmod_allocate_triplet(
-            _rows ,
-            _cols ,
-            _nb_non_zeros_in_A,
-            0, CHOLMOD_REAL, &_c);
-    
-    _rowPtrA = (int*)_triplet->i;
-    _colPtrA = (int*)_triplet->j;
-    _valuePtrA = (double*)_triplet->x;
+    _diagonalIndex.resize( vertices.size() );
+    for( int i = 0; i < _cols ; i++ )
+        _diagonalIndex[i] = find_sparse_entry( _A, i, i );
+
+    // the handles only change the diagonal of Lap^T Lap
+    if( constraintMode == SOFT ){
+        _LtLDiagonal.resize( vertices.size() );
+        for( int i = 0; i < _cols ; i++ )
+            _LtLDiagonal[i] = ((double*)_A->x)[_diagonalIndex[i]];
+    }
+
+    _L = cholmod_analyze(_A, &_c);
+    if( _L == NULL && ordering != ORDERING_AUTO ){
+        // ordering not compiled in this CHOLMOD (METIS, NESDIS)
+        _c.nmethods = 0;
+        _L = cholmod_analyze(_A, &_c);
+        configure_cholmod();
+    }
+
+    stats.nnzA = cholmod_nnz( _A, &_c );
+    stats.analyze.add( elapsed_ms( start ) );
 
-    _b = cholmod_zeros(_rows, 3, CHOLMOD_REAL, &_c);
-    _valuePtrB = (double*)_b->x;
+    if( _L == NULL || _c.status < CHOLMOD_OK )
+        return false;
 
-    //  std::cout << "allocated " << std::endl;
+    int * perm = (int*)_L->Perm;
+    _inversePerm.resize( vertices.size() );
+    for( int k = 0; k < _cols ; k++ )
+        _inversePerm[perm[k]] = k;
+
+    return true;
+}
+
+void AsRigidAsPossible::allocates_cholmod_b(  )
+{
+    _rows = ( constraintMode == SOFT ) ? _cols + constrainedNb : _cols;
+
+    if( _b == NULL || (int)_b->nrow != _rows ){
+        cholmod_free_dense(&_b, &_c);
+        _b = cholmod_zeros(_rows, 3, CHOLMOD_REAL, &_c);
+        _valuePtrB = (double*)_b->x;
+    }
+
+    if( constraintMode == SOFT && linearSolver == CHOLESKY && _Atb == NULL )
+        _Atb = cholmod_allocate_dense(_cols, 3, _cols, CHOLMOD_REAL, &_c);
 }
 
 void AsRigidAsPossible::fill_cholmod_A(  )
 {
-    
+    double * valuePtrA = (double*)_A->x;
+
+    if( constraintMode == HARD ){
+        // Laplacian restricted to the free vertices, identity on the handles
+        for( unsigned int i = 0; i < vertices.size() ; i++ ){
+            for( unsigned int h = oneRingOffsets[i]; h < oneRingOffsets[i+1] ; h++ ){
+                unsigned int j = oneRingNeighbors[h];
+                if( i < j )
+                    valuePtrA[_upperIndex[h]] = ( handles[i] || handles[j] ) ? 0. : -oneRingWeights[h];
+            }
+            valuePtrA[_diagonalIndex[i]] = handles[i] ? 1. : sumWij[i];
+        }
+        return;
+    }
 
-    sumWij.clear();
-    sumWij.resize(vertices.size(), 0.);
     for( unsigned int i = 0; i < vertices.size() ; i++ ){
-        float sum = 1.;
-        //   if( !handles[i] ){
-        sum  = 0.;
-        for( unsigned int j = 0; j < oneRing[i].size() ; j++ ){
-            Edge e( i, oneRing[i][j] );
-            float wij = edgesWeightMap[e];
-            if( i == e.v[0] )
-                add_A_coeff( i, e.v[1], -wij );
-            else
-                add_A_coeff( i, e.v[0], -wij );
-            sum += wij;
-        }
-        //    }
-        add_A_coeff( i, i, sum );
-        sumWij[i] = sum;
+        valuePtrA[_diagonalIndex[i]] = _LtLDiagonal[i];
+        if( handles[i] )
+            valuePtrA[_diagonalIndex[i]] += (double)sumWij[i] * sumWij[i];
     }
+}
 
-    int nb_found = 0;
+bool AsRigidAsPossible::update_cholmod_factor(  )
+{
+    if( _factorHandles.size() != handles.size() )
+        return false;
+
+    std::vector< int > added, removed;
     for( unsigned int i = 0; i < vertices.size() ; i++ ){
+        if( handles[i] && !_factorHandles[i] ) added.push_back( i );
+        if( !handles[i] && _factorHandles[i] ) removed.push_back( i );
+    }
+
+    if( added.size() + removed.size() > updateThreshold )
+        return false;
+
+    if( added.empty() && removed.empty() )
+        return true;
+
+    // the modifications work on a simplicial LDL' factorization : a
+    // supernodal one is copied, and only its symbolic part is kept
+    if( _L->is_super ){
+        cholmod_factor * L = cholmod_copy_factor( _L, &_c );
+        if( L == NULL || !cholmod_change_factor( CHOLMOD_REAL, false, false, false, false, L, &_c ) ){
+            cholmod_free_factor( &L, &_c );
+            return false;
+        }
+        if( _superL == NULL ){
+            cholmod_change_factor( CHOLMOD_PATTERN, _L->is_ll, true, true, true, _L, &_c );
+            _superL = _L;
+        } else {
+            cholmod_free_factor( &_L, &_c );
+        }
+        _L = L;
+    } else if( _L->is_ll ){
+        cholmod_change_factor( CHOLMOD_REAL, false, false, false, false, _L, &_c );
+    }
+
+    if( constraintMode == SOFT ){
+        // A changes by +/- sumWij^2 e_h e_h^T : rank k update with the added
+        // handles, then downdate with the removed ones (A stays positive definite)
+        for( int pass = 0 ; pass < 2 ; pass++ ){
+            const std::vector< int > & changed = ( pass == 0 ) ? added : removed;
+            if( changed.empty() ) continue;
+
+            cholmod_sparse * C = cholmod_allocate_sparse( _cols, changed.size(), changed.size(), 1, 1, 0, CHOLMOD_REAL, &_c );
+            int * Cp = (int*)C->p;
+            int * Ci = (int*)C->i;
+            double * Cx = (double*)C->x;
+            for( unsigned int k = 0 ; k < changed.size() ; k++ ){
+                Cp[k] = k;
+                Ci[k] = _inversePerm[changed[k]];
+                Cx[k] = sumWij[changed[k]];
+            }
+            Cp[changed.size()] = changed.size();
+
+            bool updated = cholmod_updown( pass == 0, C, _L, &_c ) && _c.status == CHOLMOD_OK;
+            cholmod_free_sparse( &C, &_c );
+            if( !updated )
+                return false;
+        }
+        return true;
+    }
+
+    // HARD : the rows of the new handles become identity rows (rowdel), then
+    // the rows of the freed vertices are added back one by one, coupled only
+    // to the rows currently in the factorization
+    std::vector< bool > inFactor( vertices.size() );
+    for( unsigned int i = 0; i < vertices.size() ; i++ )
+        inFactor[i] = !_factorHandles[i];
+
+    for( unsigned int k = 0 ; k < added.size() ; k++ ){
+        if( !cholmod_rowdel( _inversePerm[added[k]], NULL, _L, &_c ) )
+            return false;
+        inFactor[added[k]] = false;
+    }
+
+    for( unsigned int k = 0 ; k < removed.size() ; k++ ){
+        unsigned int i = removed[k];
+
+        std::vector< std::pair< int, double > > column;
+        column.push_back( std::make_pair( _inversePerm[i], (double)sumWij[i] ) );
+        for( unsigned int h = oneRingOffsets[i]; h < oneRingOffsets[i+1] ; h++ ){
+            unsigned int j = oneRingNeighbors[h];
+            if( inFactor[j] )
+                column.push_back( std::make_pair( _inversePerm[j], (double)-oneRingWeights[h] ) );
+        }
+        std::sort( column.begin(), column.end() );
+
+        cholmod_sparse * Rk = cholmod_allocate_sparse( _cols, 1, column.size(), 1, 1, 0, CHOLMOD_REAL, &_c );
+        int * Rp = (int*)Rk->p;
+        int * Ri = (int*)Rk->i;
+        double * Rx = (double*)Rk->x;
+        Rp[0] = 0;
+        Rp[1] = column.size();
+        for( unsigned int c = 0 ; c < column.size() ; c++ ){
+            Ri[c] = column[c].first;
+            Rx[c] = column[c].second;
+        }
+
+        bool updated = cholmod_rowadd( _inversePerm[i], Rk, _L, &_c ) && _c.status == CHOLMOD_OK;
+        cholmod_free_sparse( &Rk, &_c );
+        if( !updated )
+            return false;
+        inFactor[i] = true;
+    }
+
+    return true;
+}
+
+// FNV-1a hash of a handle bitset
+static size_t handles_key( const std::vector< bool > & handles ){
+    size_t key = 14695981039346656037ULL;
+    for( unsigned int i = 0 ; i < handles.size() ; i++ ){
         if( handles[i] ){
-            add_A_coeff( vertices.size() + nb_found, i, sumWij[i] );
-            ++nb_found;
+            key ^= i;
+            key *= 1099511628211ULL;
         }
     }
-    
+    return key;
 }
 
-void AsRigidAsPossible::draw(){
-    for( unsigned int i = 0 ; i < vertices.size() ; i++ ){
-        Vec3Df & center = vertices[i];
+// Approximate memory used by a factorization (no values in a symbolic one)
+static size_t factor_bytes( cholmod_factor * L ){
+    size_t bytes = 2 * L->n * sizeof(int);
+    if( L->is_super )
+        return bytes + ( L->xtype != CHOLMOD_PATTERN ? L->xsize * sizeof(double) : 0 ) + ( L->ssize + 4 * L->nsuper ) * sizeof(int);
+    return bytes + L->nzmax * ( sizeof(double) + sizeof(int) ) + 5 * L->n * sizeof(int);
+}
+
+bool AsRigidAsPossible::swap_cached_factor(  )
+{
+    size_t key = handles_key( handles );
+
+    for( std::list< CachedFactor >::iterator it = factorCache.begin() ; it != factorCache.end() ; ++it ){
+        if( it->key != key || it->handles != handles )
+            continue;
 
-        glColor3f(.3,0.3,0.3);
-        float radius = 1.;
-        if( handles.size() >0 && handles[i] ){
-            radius *= 3;
-            glColor3f(0.,0.8,0.);
+        // the current factorization takes the place of the cached one
+        cholmod_factor * L = it->L;
+        factorCacheBytes -= it->bytes;
+        if( _factorHandles.empty() ){
+            factorCache.erase( it );
+        } else {
+            it->handles = _factorHandles;
+            it->key = handles_key( _factorHandles );
+            it->bytes = factor_bytes( _L );
+            it->L = _L;
+            factorCacheBytes += it->bytes;
+            factorCache.splice( factorCache.begin(), factorCache, it );
         }
 
-        BasicGL::drawSphere( center[0], center[1], center[2], radius, 30, 30 );
+        _L = L;
+        trim_factor_cache( factorCacheBudget );
+        return true;
+    }
+
+    return false;
+}
+
+void AsRigidAsPossible::cache_factor(  )
+{
+    if( _factorHandles.empty() || _factorHandles == handles )
+        return;
+
+    size_t bytes = factor_bytes( _L );
+    if( bytes > factorCacheBudget )
+        return;
+
+    CachedFactor cached;
+    cached.handles = _factorHandles;
+    cached.key = handles_key( _factorHandles );
+    cached.bytes = bytes;
+    cached.L = cholmod_copy_factor( _L, &_c );
+    if( cached.L == NULL )
+        return;
+
+    factorCache.push_front( cached );
+    factorCacheBytes += bytes;
+    trim_factor_cache( factorCacheBudget );
+}
+
+void AsRigidAsPossible::trim_factor_cache( size_t budget )
+{
+    while( !factorCache.empty() && factorCacheBytes > budget ){
+        factorCacheBytes -= factorCache.back().bytes;
+        cholmod_free_factor( &factorCache.back().L, &_c );
+        factorCache.pop_back();
+    }
+}
+
+void AsRigidAsPossible::setFactorCacheBudget( size_t bytes )
+{
+    factorCacheBudget = bytes;
+    if( data_loaded ){
+        trim_factor_cache( factorCacheBudget );
+        update_factor_stats();
+    }
+}
+
+void AsRigidAsPossible::update_factor_stats(  )
+{
+    stats.nnzL = 0;
+    stats.factorBytes = 0;
+    stats.factorOrdering = -1;
+    stats.supernodalFactor = false;
+    if( _L != NULL && !borrowedSystem ){
+        stats.nnzL = _L->is_super ? _L->xsize : _L->nzmax;
+        stats.factorBytes = factor_bytes( _L );
+        if( _superL != NULL )
+            stats.factorBytes += factor_bytes( _superL );
+        stats.factorOrdering = _L->ordering;
+        stats.supernodalFactor = _L->is_super || _superL != NULL;
+    }
+    stats.cacheBytes = factorCacheBytes;
+}
+
+void AsRigidAsPossible::free_cholmod_A_system(  )
+{
+    trim_factor_cache( 0 );
+    cholmod_free_sparse(&_Lap, &_c);
+    cholmod_free_sparse(&_A, &_c);
+    cholmod_free_factor(&_L, &_c);
+    cholmod_free_factor(&_superL, &_c);
+    _LtLDiagonal.clear();
+    _diagonalIndex.clear();
+    _upperIndex.clear();
+    _inversePerm.clear();
+    _factorHandles.clear();
+    stats.nnzA = 0;
+    update_factor_stats();
+}
+
+void AsRigidAsPossible::configure_cholmod(  )
+{
+    static const int supernodal[] = { CHOLMOD_AUTO, CHOLMOD_SIMPLICIAL, CHOLMOD_SUPERNODAL };
+    static const int orderings[] = { CHOLMOD_AMD, CHOLMOD_AMD, CHOLMOD_METIS, CHOLMOD_NESDIS };
+
+    _c.supernodal = supernodal[factorization];
+
+    // a single forced ordering, or the default strategy of CHOLMOD
+    if( ordering == ORDERING_AUTO ){
+        _c.nmethods = 0;
+    } else {
+        _c.nmethods = 1;
+        _c.method[0].ordering = orderings[ordering];
     }
 }
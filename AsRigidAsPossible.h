@@ -2,19 +2,111 @@
 #define ASRIGIDASPOSSIBLE_H
 
 #include "Vec3D.h"
-#include "Edge.h"
 #include "Triangle.h"
-#include "gsl/gsl_linalg.h"
 
 #include "cholmod.h"
 
+#include <algorithm>
+#include <list>
+
+
+// Row-major 3x3 matrix stored by value, so that the rotations of all the
+// vertices lie in one contiguous array
+struct Mat3Df {
+    float m[9];
+
+    inline void setIdentity(){
+        for( int k = 0 ; k < 9 ; k++ )
+            m[k] = ( k % 4 == 0 ) ? 1.f : 0.f;
+    }
+};
 
 class AsRigidAsPossible
 {
 public:
+    // SOFT : handles are extra least squares rows weighted by sumWij, the
+    //        system solved is At*A (bi-Laplacian).
+    // HARD : handles are eliminated, their rows and columns of the Laplacian
+    //        are replaced by the identity and their contributions are moved to
+    //        the right hand side, so only the Laplacian itself is factorized.
+    enum ConstraintMode { SOFT , HARD };
+
+    // CHOLESKY           : sparse Cholesky factorization with CHOLMOD
+    // CONJUGATE_GRADIENT : matrix-free conjugate gradient preconditioned by
+    //                      the diagonal, warm-started from the current
+    //                      positions. Needs no factorization, so its memory
+    //                      stays linear in the number of vertices.
+    enum LinearSolver { CHOLESKY , CONJUGATE_GRADIENT };
+
+    // Preconditioner of the CONJUGATE_GRADIENT solver.
+    // JACOBI              : inverse of the diagonal of the system, applied in
+    //                       parallel.
+    // INCOMPLETE_CHOLESKY : zero fill-in incomplete Cholesky factor of the
+    //                       system (one-ring pattern in HARD mode, two-ring in
+    //                       SOFT mode). Fewer iterations, but its triangular
+    //                       solves are sequential (one thread per coordinate)
+    //                       and the factor is as large as the system. Falls
+    //                       back to JACOBI when it cannot be computed.
+    // SOFT mode solves the bi-Laplacian, far worse conditioned : on a 41k
+    // vertex sphere JACOBI stops at the iteration limit (1000) on every solve
+    // and INCOMPLETE_CHOLESKY still takes about 600 iterations per solve.
+    enum Preconditioner { JACOBI , INCOMPLETE_CHOLESKY };
+
+    // CHOLMOD configuration of the CHOLESKY solver. The AUTO values keep the
+    // CHOLMOD defaults : supernodal or simplicial chosen from the fill, AMD
+    // ordering (and METIS when AMD fills too much and CHOLMOD has it).
+    // A forced ordering unavailable in the CHOLMOD build falls back to AUTO.
+    // The defaults are AUTO, not tuned on ARAP systems : compare them with
+    // arapBenchmark --factorization ... --ordering ... --table.
+    enum Factorization { FACTORIZATION_AUTO , SIMPLICIAL , SUPERNODAL };
+    enum Ordering { ORDERING_AUTO , ORDERING_AMD , ORDERING_METIS , ORDERING_NESDIS };
+
+    // Time in milliseconds of the last call of a phase, total time and number
+    // of calls since init
+    struct PhaseTiming {
+        double last;
+        double total;
+        unsigned int calls;
+
+        PhaseTiming() : last(0.), total(0.), calls(0) {}
+        inline void add( double ms ){ last = ms; total += ms; calls++; }
+        inline double mean() const { return calls > 0 ? total / calls : 0.; }
+    };
+
+    // Timings and counters since init. adjacency is the part of init building
+    // the one-ring and its cotangent weights, analyze the symbolic analysis,
+    // factorize the numeric part of setHandles (full factorization, low-rank
+    // update or cached factor), deformation a whole compute_deformation (the
+    // coarser levels included) and rhs, solve, localStep the phases of one
+    // iteration of this level. nnzA and nnzL are the stored entries of the
+    // factorized matrix and of its factor, factorBytes the memory of the
+    // current factor and cacheBytes the one of the factor cache.
+    // factorOrdering is the fill-reducing ordering CHOLMOD used for the
+    // factor (CHOLMOD_AMD, CHOLMOD_METIS..., -1 without factor) and
+    // supernodalFactor whether it chose a supernodal one, which the AUTO
+    // values leave to CHOLMOD.
+    struct Stats {
+        PhaseTiming init, adjacency, analyze, factorize, deformation, rhs, solve, localStep;
+        unsigned int iterations;
+        unsigned int totalIterations;
+        unsigned int factorizations, factorUpdates, cachedFactors;
+        size_t nnzA, nnzL;
+        size_t factorBytes, cacheBytes;
+        int factorOrdering;
+        bool supernodalFactor;
+
+        Stats() : iterations(0), totalIterations(0), factorizations(0), factorUpdates(0), cachedFactors(0),
+            nnzA(0), nnzL(0), factorBytes(0), cacheBytes(0), factorOrdering(-1), supernodalFactor(false) {}
+    };
+
     AsRigidAsPossible();
 
     ~AsRigidAsPossible();
+
+    // owns the CHOLMOD objects and the coarser levels : not copyable
+    AsRigidAsPossible( const AsRigidAsPossible & ) = delete;
+    AsRigidAsPossible & operator=( const AsRigidAsPossible & ) = delete;
+
     void init( const std::vector<Vec3Df> & _vertices, const std::vector< Triangle > & _triangles);
     void init( const std::vector<Vec3Df> & _vertices, const std::vector< std::vector <int> > & _triangles );
 
@@ -26,30 +118,178 @@ public:
     inline std::vector< bool > & getHandles(){ return handles; }
     inline const std::vector< bool > & getHandles() const { return handles; }
 
-    void setHandles(const std::vector< bool > & _handles);
+    // Returns false when CHOLMOD fails to analyze or factorize the system
+    // (out of memory, not positive definite) : the solver is then left
+    // without handles and compute_deformation does nothing.
+    bool setHandles(const std::vector< bool > & _handles);
     void compute_deformation(std::vector<Vec3Df> & positions);
 
+    // Progressive refinement for interactive clients : a single
+    // local-global iteration on the finest level, from positions and the
+    // current rotations. restart begins a new deformation (new handle
+    // positions), otherwise the iteration continues the previous ones and
+    // getIterationsUsed counts all of them. Returns true once converged, by
+    // the test of setTolerance (1e-4 when the tolerance is 0).
+    bool refine_deformation(std::vector<Vec3Df> & positions, bool restart);
+
+    // Deforms a sequence of frames sharing the current handle set against
+    // its factorization : frames[f] holds the handle positions of frame f
+    // and receives its result. The frames are split into threadNb contiguous
+    // runs solved in parallel, each with its own rotations. Within a run the
+    // free vertices and the rotations of a frame start from the result of
+    // the previous frame, the first frame of a run starting from its own
+    // positions and the current rotations, so the results depend on threadNb.
+    void compute_deformations(std::vector< std::vector<Vec3Df> > & frames);
+
+    // Maximum number of iterations of compute_deformation
     void setIterationNb(unsigned int itNb){ iterationNb = itNb; }
     unsigned int getIterationNb(){ return iterationNb; }
 
-    void draw();
+    // compute_deformation stops before iterationNb iterations once the
+    // relative change of the ARAP energy and the largest displacement of an
+    // iteration (relative to the bounding box diagonal of the rest mesh) are
+    // both below tolerance. 0 always runs iterationNb iterations.
+    void setTolerance(double tol){ tolerance = tol; }
+    double getTolerance(){ return tolerance; }
+
+    // Anderson acceleration of the local-global iterations, mixing the last m
+    // steps (0, the default, disables it). An accelerated step that
+    // increases the ARAP energy is replaced by the plain step.
+    void setAndersonWindow(unsigned int m);
+    unsigned int getAndersonWindow(){ return andersonWindow; }
+
+    // Report of the last compute_deformation : iterations done, final ARAP
+    // energy sum_i sum_j wij |(pi - pj) - Ri (vi - vj)|^2, and the energy and
+    // relative displacement of every iteration
+    unsigned int getIterationsUsed() const { return step; }
+    double getEnergy() const { return energy; }
+    const std::vector<double> & getIterationEnergies() const { return iterationEnergies; }
+    const std::vector<float> & getIterationChanges() const { return iterationChanges; }
+
+    const Stats & getStats() const { return stats; }
+
+    // Number of threads used by the local step and the right-hand side
+    // assembly (all the cores by default). Every vertex is processed
+    // independently, so the result does not depend on this number.
+    void setThreadNb(unsigned int thNb){ threadNb = std::max( thNb, 1u ); }
+    unsigned int getThreadNb(){ return threadNb; }
+
+    void setConstraintMode(ConstraintMode mode);
+    ConstraintMode getConstraintMode(){ return constraintMode; }
+
+    void setLinearSolver(LinearSolver solver);
+    LinearSolver getLinearSolver(){ return linearSolver; }
+
+    void setFactorization(Factorization factorization);
+    Factorization getFactorization(){ return factorization; }
+    void setOrdering(Ordering ordering);
+    Ordering getOrdering(){ return ordering; }
+
+    // Threads of the BLAS used by the supernodal factorization and solves,
+    // set through openblas_set_num_threads / mkl_set_num_threads when the
+    // program is linked with one of them (process wide). 0 keeps the BLAS default.
+    void setBlasThreadNb(unsigned int thNb);
+    unsigned int getBlasThreadNb(){ return blasThreadNb; }
+
+    // The conjugate gradient stops when the residual of every coordinate is
+    // below tolerance times its right hand side, or after itNb iterations.
+    // getConjugateGradientIterations is the total of the last compute_deformation.
+    void setConjugateGradientTolerance(double tol){ cgTolerance = tol; }
+    double getConjugateGradientTolerance(){ return cgTolerance; }
+    void setConjugateGradientIterationNb(unsigned int itNb){ cgIterationNb = itNb; }
+    unsigned int getConjugateGradientIterationNb(){ return cgIterationNb; }
+    unsigned int getConjugateGradientIterations() const { return cgIterationsUsed; }
+    void setConjugateGradientPreconditioner(Preconditioner preconditioner);
+    Preconditioner getConjugateGradientPreconditioner(){ return cgPreconditioner; }
+
+    // A handle set differing from the factorized one by at most
+    // updateThreshold vertices is applied as low-rank modifications of the
+    // current factorization (cholmod_updown in SOFT mode, cholmod_rowdel /
+    // cholmod_rowadd in HARD mode) instead of a new factorization.
+    // 0 refactorizes on any change. The modifications need a simplicial
+    // factor : a supernodal one is copied to a simplicial one for them, and
+    // its symbolic part is kept for the next full factorization.
+    // Their cost grows linearly with the number of changed vertices, HARD
+    // mode being the steepest : CHOLMOD deletes and adds one row per
+    // cholmod_rowdel / cholmod_rowadd call, where cholmod_updown applies
+    // several columns per pass. The default of 128 is about half the
+    // smallest crossover with a full simplicial factorization measured by
+    // arapBenchmark --handle-changes on spheres of 10k and 164k vertices
+    // (about 230 changes, HARD on 10k vertices; 870 and more otherwise).
+    void setUpdateThreshold(unsigned int threshold){ updateThreshold = threshold; }
+    unsigned int getUpdateThreshold(){ return updateThreshold; }
+
+    // The factorizations of the previous handle sets are kept, least recently
+    // used first out, within factorCacheBudget bytes (256 MB by default) :
+    // coming back to one of them needs no factorization. 0 disables the cache.
+    void setFactorCacheBudget(size_t bytes);
+    size_t getFactorCacheBudget(){ return factorCacheBudget; }
+
+    // Multiresolution : init builds levelNb - 1 coarser meshes by vertex
+    // clustering (1, the default, solves on the mesh only). Each
+    // compute_deformation solves on the coarsest mesh with iterationNb
+    // iterations, then prolongates its rotations and positions to the next
+    // finer level as initial guess and runs fineIterationNb iterations there.
+    // The level number takes effect at the next init.
+    void setLevelNb(unsigned int levels){ levelNb = std::max( levels, 1u ); }
+    unsigned int getLevelNb(){ return levelNb; }
+    void setFineIterationNb(unsigned int itNb){ fineIterationNb = itNb; }
+    unsigned int getFineIterationNb(){ return fineIterationNb; }
+
+    // The local step fits one rotation per cluster of about size vertices,
+    // grown over the mesh by geodesic distance, from the sum of the
+    // covariances of its vertices (1, the default, fits one rotation per
+    // vertex). Divides the number of rotation fittings by size at the price
+    // of a stiffer deformation.
+    void setRotationClusterSize(unsigned int size);
+    unsigned int getRotationClusterSize(){ return rotationClusterSize; }
+    unsigned int getRotationClusterNb() const { return rotationClusterOffsets.empty() ? vertices.size() : rotationClusterOffsets.size() - 1; }
 
     void clear();
 
 protected:
 
-    void compute_product_and_sum( gsl_matrix * R, const Vec3Df & point, Vec3Df & result );
-    void compute_S( gsl_matrix * S , unsigned int vi, const std::vector<Vec3Df> & pdef);
-    void compute_R( gsl_matrix * R , gsl_matrix * U, gsl_matrix * V );
-    float compute_determinant( gsl_matrix * M );
-    void singular_value_decomposition( gsl_matrix * matrix, gsl_matrix * U, gsl_matrix * V );
-    void factorize_cholmod_A_system();void add_A_coeff( const int row , const int col , const double value );
-    void update_A_coeff( const int i , const double value );
+    void compute_product_and_sum( const double * M, const Vec3Df & point, Vec3Df & result );
+    void compute_S( double * S , unsigned int vi, const std::vector<Vec3Df> & pdef);
+    double compute_energy( unsigned int vi, const std::vector<Vec3Df> & pdef);
+    void set_handle_positions( const std::vector<Vec3Df> & positions );
+    float global_step( std::vector<Vec3Df> & positions );
+    void build_rhs( const std::vector<Vec3Df> & positions );
+    float solve_positions( std::vector<Vec3Df> & positions );
+    double local_step( const std::vector<Vec3Df> & positions );
+    void anderson_reset();
+    void anderson_store( const std::vector<Vec3Df> & positions, std::vector<double> & x );
+    void anderson_restore( const std::vector<double> & x, std::vector<Vec3Df> & positions );
+    bool anderson_step( std::vector<Vec3Df> & positions );
+    bool factorize_cholmod_A_system();void add_A_coeff( const int row , const int col , const double value );
     void set_b_value( const int i , const Vec3Df & value );
     cholmod_dense* solve_cholmod();
-    void allocates_cholmod_A_and_b(  );
+    void compute_cg_preconditioner();
+    bool compute_incomplete_cholesky( double shift );
+    void apply_cg_preconditioner( const double * r , double * z );
+    void apply_laplacian( const double * x , double * y , bool restricted );
+    void apply_cg_system( const double * x , double * y );
+    void cg_dot( const double * a , const double * b , double * dots );
+    const double * solve_conjugate_gradient( const std::vector<Vec3Df> & positions );
+    bool analyze_cholmod_A_system(  );
+    void allocates_cholmod_b(  );
     void fill_cholmod_A(  );
+    bool update_cholmod_factor(  );
+    bool swap_cached_factor(  );
+    void cache_factor(  );
+    void trim_factor_cache( size_t budget );
+    void free_cholmod_A_system(  );
+    void configure_cholmod(  );
+    void update_factor_stats(  );
+    bool cholmod_failure( const char * step );
+    AsRigidAsPossible * create_frame_worker(  );
     void setDefaultRotations();
+    void build_rotation_clusters();
+    void build_coarser_level( const std::vector< Triangle > & triangles );
+    void configure_coarser();
+    void restrict_to_coarser( const std::vector<Vec3Df> & positions );
+    void prolongate_from_coarser( std::vector<Vec3Df> & positions );
+    void buildOneRingTable();
 
     int constrainedNb;
     // PARTIE CHOLMOD , ininteressante //
@@ -60,15 +300,81 @@ protected:
     int *_colPtrA;
     double *_valuePtrA;
 
-    cholmod_sparse *_At;
+    // The pattern of the factorized matrix does not depend on the handles :
+    // _A and the symbolic analysis _L are built once per topology (and
+    // constraint mode), a handle change only refills the values of _A and
+    // runs the numeric factorization again.
+    //   SOFT : _A = Lap^T Lap + sum over the handles of sumWij^2 e_h e_h^T
+    //   HARD : _A = Lap with identity rows and columns on the handles
+    // _Lap is the cotangent Laplacian (SOFT only, for the right hand sides),
+    // _LtLDiagonal the diagonal of Lap^T Lap (SOFT only, the rest of _A does
+    // not depend on the handles), and _diagonalIndex / _upperIndex give the
+    // position in _A->x of the diagonal coefficients and of the coefficient
+    // of each half-edge (HARD only).
+    cholmod_sparse *_Lap;
+    cholmod_sparse *_A;
+    std::vector< double > _LtLDiagonal;
+    std::vector< int > _diagonalIndex;
+    std::vector< int > _upperIndex;
 
+    // _L->Perm inverted (row of L of each vertex) and handles of the current
+    // numeric factorization, used by the low-rank updates
     cholmod_factor *_L;
+    std::vector< int > _inversePerm;
+    // symbolic supernodal analysis kept while _L is its simplicial copy
+    // modified by low-rank updates (NULL otherwise)
+    cholmod_factor *_superL;
+    std::vector< bool > _factorHandles;
+
+    // Factorizations of previous handle sets, most recently used first, keyed
+    // by a hash of the handle bitset
+    struct CachedFactor {
+        std::vector< bool > handles;
+        size_t key;
+        size_t bytes;
+        cholmod_factor * L;
+    };
+    std::list< CachedFactor > factorCache;
+    size_t factorCacheBytes;
+    size_t factorCacheBudget;
 
     cholmod_dense *_b;
     double *_valuePtrB;
 
+    // Solve workspaces kept from one iteration to the next : At*b (SOFT),
+    // solution and cholmod_solve2 workspaces
+    cholmod_dense *_Atb;
+    cholmod_dense *_x;
+    cholmod_dense *_Y;
+    cholmod_dense *_E;
+
     cholmod_common _c;
 
+    // Frame workers of compute_deformations use _Lap and _L of the solver
+    // that created them, which owns and frees them
+    bool borrowedSystem;
+
+    // Conjugate gradient : solution, residual, preconditioned residual,
+    // direction, system times direction, right hand side and Laplacian
+    // product (SOFT), all 3 x vertices.size() with one column per coordinate,
+    // the inverse of the diagonal of the system and the per-chunk dot products
+    LinearSolver linearSolver;
+    Factorization factorization;
+    Ordering ordering;
+    unsigned int blasThreadNb;
+    double cgTolerance;
+    unsigned int cgIterationNb;
+    unsigned int cgIterationsUsed;
+    std::vector<double> cgX, cgR, cgZ, cgP, cgQ, cgB, cgT;
+    std::vector<double> cgInverseDiagonal;
+    // incomplete Cholesky factor, lower triangular rows with sorted columns,
+    // the diagonal coefficient last, and the lower part of the system it
+    // is computed from
+    Preconditioner cgPreconditioner;
+    std::vector<unsigned int> icOffsets, icColumns;
+    std::vector<double> icValues, icSystem;
+    std::vector<double> cgPartialDots;
+
     int _nb_non_zeros_in_A;
 
     unsigned int step;
@@ -76,12 +382,62 @@ protected:
     bool data_loaded;
     /////////////////////////////////////
     unsigned int iterationNb;
+    double tolerance;
+    float restScale;
+    double energy;
+    std::vector<double> iterationEnergies;
+    std::vector<float> iterationChanges;
+    unsigned int threadNb;
+    Stats stats;
+
+    // Anderson acceleration : x the positions before the global step, g the
+    // positions after it and f = g - x, with the previous g and f, the window
+    // of their differences (column j at j*3*vertices.size()) and dF^T dF
+    unsigned int andersonWindow;
+    struct AndersonHistory {
+        std::vector<double> x, g, f, previousG, previousF;
+        std::vector<double> dG, dF;
+        std::vector<double> gram, system, theta;
+        unsigned int count, column;
+        bool hasPrevious;
+    } anderson;
+
+    // Next coarser level of the hierarchy (NULL on the coarsest one) : every
+    // vertex belongs to the cluster fineToCoarse[i], represented by the vertex
+    // coarseRepresentatives[c] and made a handle of the coarser level when it
+    // contains coarseHandleCounts[c] > 0 handles
+    unsigned int levelNb;
+    unsigned int fineIterationNb;
+    AsRigidAsPossible * coarser;
+    std::vector< unsigned int > fineToCoarse;
+    std::vector< unsigned int > coarseRepresentatives;
+    std::vector< unsigned int > coarseHandleCounts;
+    std::vector< Vec3Df > coarsePositions;
+
+    unsigned int updateThreshold;
+    ConstraintMode constraintMode;
     std::vector< Vec3Df > vertices;
-    CotangentWeights edgesWeightMap;
-    std::map<Edge, Vec3Df, compareEdge> bij;
     std::vector< bool > handles;
-    std::vector< std::vector<unsigned int> > oneRing;
-    std::vector<gsl_matrix *> R;
+
+    // One-ring in CSR layout : the half-edges (i,j) leaving vertex i are stored
+    // in [ oneRingOffsets[i] , oneRingOffsets[i+1] [ with their cotangent weight
+    // and bij = wij/2 * ( vi - vj ), so that the iterations never query an Edge map.
+    std::vector< unsigned int > oneRingOffsets;
+    std::vector< unsigned int > oneRingNeighbors;
+    std::vector< float > oneRingWeights;
+    std::vector< Vec3Df > oneRingBij;
+    std::vector<Mat3Df> R;
+    // Rotation clusters in CSR layout (empty when every vertex has its own
+    // rotation) and cluster of each vertex
+    unsigned int rotationClusterSize;
+    std::vector< unsigned int > rotationClusterOffsets;
+    std::vector< unsigned int > rotationClusterVertices;
+    std::vector< unsigned int > rotationClusters;
+    // Local step covariances and fitted rotations, as structures of arrays
+    // (coefficient k of vertex i at k*vertices.size() + i) for RotationFitting
+    std::vector<float> localS;
+    std::vector<float> localR;
+    std::vector<double> chunkEnergies;
     std::vector<float> sumWij;
 
 };
@@ -16,6 +16,19 @@
 #  include <cctype>
 using std::isspace;
 
+#include "Vec3D.h"
+#include "FileIO.h"
+
+inline void glVertex( Vec3Df const & p )
+{
+    glVertex3f( p[0] , p[1] , p[2] );
+}
+
+inline void glNormal( Vec3Df const & p )
+{
+    glNormal3f( p[0] , p[1] , p[2] );
+}
+
 
 
 namespace RGB
@@ -171,313 +184,6 @@ namespace GLCheck{
     int checkErrors( std::string const & szFile , int iLine );
 }
 
-namespace FileIO{
-    template <typename Point, typename Face>
-            bool read(std::istream& _in, std::vector<Point> & vertices, std::vector<Face> & triangles )
-    {
-        std::cout << "[OBJReader] : read file\n";
-
-
-        std::string line;
-        std::string keyWrd;
-
-        float                  x, y, z;
-
-        std::vector<int> vhandles;
-
-        while( _in && !_in.eof() )
-        {
-            std::getline(_in,line);
-            if ( _in.bad() ){
-                std::cout << "  Warning! Could not read file properly!\n";
-                return false;
-            }
-
-            size_t start = line.find_first_not_of(" \t\r\n");
-            size_t end   = line.find_last_not_of(" \t\r\n");
-
-            if(( std::string::npos == start ) || ( std::string::npos == end))
-                line = "";
-            else
-                line = line.substr( start, end-start+1 );
-
-            // comment
-            if ( line.size() == 0 || line[0] == '#' || isspace(line[0]) ) {
-                continue;
-            }
-
-            std::stringstream stream(line);
-
-            stream >> keyWrd;
-
-            // material file
-            if (keyWrd == "mtllib" || keyWrd == "usemtl")
-            {
-
-            }
-            // vertex
-            else if (keyWrd == "v")
-            {
-                stream >> x; stream >> y; stream >> z;
-
-                if ( !stream.fail() )
-                    vertices.push_back(Point(x,y,z));
-            }
-
-            // texture coord
-            else if (keyWrd == "vt" || keyWrd == "vn")
-            {
-
-            }
-            // face
-            else if (keyWrd == "f")
-            {
-                int component(0), nV(0);
-                int value;
-
-                vhandles.clear();
-
-                // read full line after detecting a face
-                std::string faceLine;
-                std::getline(stream,faceLine);
-                std::stringstream lineData( faceLine );
-
-                // work on the line until nothing left to read
-                while ( !lineData.eof() )
-                {
-                    // read one block from the line ( vertex/texCoord/normal )
-                    std::string vertex;
-                    lineData >> vertex;
-
-                    do{
-
-                        //get the component (vertex/texCoord/normal)
-                        size_t found=vertex.find("/");
-
-                        // parts are seperated by '/' So if no '/' found its the last component
-                        if( found != std::string::npos ){
-
-                            // read the index value
-                            std::stringstream tmp( vertex.substr(0,found) );
-
-                            // If we get an empty string this property is undefined in the file
-                            if ( vertex.substr(0,found).empty() ) {
-                                // Switch to next field
-                                vertex = vertex.substr(found+1);
-
-                                // Now we are at the next component
-                                ++component;
-
-                                // Skip further processing of this component
-                                continue;
-                            }
-
-                            // Read current value
-                            tmp >> value;
-
-                            // remove the read part from the string
-                            vertex = vertex.substr(found+1);
-
-                        } else {
-
-                            // last component of the vertex, read it.
-                            std::stringstream tmp( vertex );
-                            tmp >> value;
-
-                            // Clear vertex after finished reading the line
-                            vertex="";
-
-                            // Nothing to read here ( garbage at end of line )
-                            if ( tmp.fail() ) {
-                                continue;
-                            }
-                        }
-
-                        // store the component ( each component is referenced by the index here! )
-                        switch (component)
-                        {
-                        case 0: // vertex
-                            if ( value < 0 ) {
-                                // Calculation of index :
-                                // -1 is the last vertex in the list
-                                // As obj counts from 1 and not zero add +1
-                                value = vertices.size() + value + 1;
-                            }
-                            // Obj counts from 1 and not zero .. array counts from zero therefore -1
-                            vhandles.push_back(value-1);
-                            break;
-
-                case 1: // texture coord
-                    break;
-
-                case 2: // normal
-                    break;
-                }
-
-                        // Prepare for reading next component
-                        ++component;
-
-                        // Read until line does not contain any other info
-                    } while ( !vertex.empty() );
-
-                    component = 0;
-                    nV++;
-                }
-
-                if (vhandles.size()>3)
-                {
-                    //model is not triangulated, so let us do this on the fly...
-                    //to have a more uniform mesh, we add randomization
-                    unsigned int k=(false)?(rand()%vhandles.size()):0;
-                    for (unsigned int i=0;i<vhandles.size()-2;++i)
-                    {
-                        triangles.push_back(Face(vhandles[(k+0)%vhandles.size()],vhandles[(k+i+1)%vhandles.size()],vhandles[(k+i+2)%vhandles.size()]));
-                    }
-                }
-                else if (vhandles.size()==3)
-                {
-                    triangles.push_back(Face(vhandles[0],vhandles[1],vhandles[2]));
-                }
-                else
-                {
-                    printf("TriMesh::LOAD: Unexpected number of face vertices (<3). Ignoring face");
-                }
-            }
-
-        }
-
-        return true;
-    }
-
-    template <typename Point, typename Face>
-            bool objLoader(const std::string& _filename, std::vector<Point> & vertices, std::vector<Face> & triangles)
-    {
-
-        std::fstream in( _filename.c_str(), std::ios_base::in );
-
-        if (!in.is_open() || !in.good())
-        {
-            std::cout << "[OBJReader] : cannot not open file "
-                    << _filename
-                    << std::endl;
-            return false;
-        }
-
-        {
-#if defined(WIN32)
-            std::string::size_type dot = _filename.find_last_of("\\/");
-#else
-            std::string::size_type dot = _filename.rfind("/");
-#endif
-            std::string path_ = (dot == std::string::npos)
-                                ? "./"
-                                    : std::string(_filename.substr(0,dot+1));
-        }
-
-        bool result = FileIO::read(in, vertices, triangles);
-
-        in.close();
-        return result;
-    }
-
-    template <typename Point, typename Face>
-    void openOFF( std::string const & filename  , std::vector<Point> & vertices, std::vector<Face> & triangles)
-    {
-        std::ifstream myfile;
-        myfile.open(filename.c_str());
-        if (!myfile.is_open())
-        {
-            std::cout << filename << " cannot be opened" << std::endl;
-            return;
-        }
-
-        std::string magic_s;
-
-        myfile >> magic_s;
-
-        if( magic_s != "OFF" )
-        {
-            std::cout << magic_s << " != OFF :   We handle ONLY *.off files." << std::endl;
-            myfile.close();
-            exit(1);
-        }
-
-
-
-        int n_vertices , n_faces , dummy_int;
-        myfile >> n_vertices >> n_faces >> dummy_int;
-
-
-        vertices.clear();
-
-        for( int v = 0 ; v < n_vertices ; ++v )
-        {
-            float x , y , z;
-            myfile >> x >> y >> z ;
-            vertices.push_back( Point( x , y , z ) );
-        }
-
-        triangles.clear();
-        for( int f = 0 ; f < n_faces ; ++f )
-        {
-            int n_vertices_on_face;
-            myfile >> n_vertices_on_face;
-            if( n_vertices_on_face == 3 )
-            {
-                int _v1 , _v2 , _v3;
-                myfile >> _v1 >> _v2 >> _v3;
-                triangles.push_back( Face(_v1, _v2, _v3) );
-            }
-            else if( n_vertices_on_face == 4 )
-            {
-                int _v1 , _v2 , _v3 , _v4;
-
-                myfile >> _v1 >> _v2 >> _v3 >> _v4;
-                triangles.push_back( Face(_v1, _v2, _v3) );
-                triangles.push_back( Face(_v1, _v3, _v4) );
-            }
-            else
-            {
-                std::cout << "We handle ONLY *.off files with 3 or 4 vertices per face" << std::endl;
-                myfile.close();
-                exit(1);
-            }
-        }
-
-    }
-
-    template <typename Point, typename Face>
-   bool saveOFF(const std::string& filename, std::vector<Point> & vertices, std::vector<Face> & triangles)
-    {
-
-            std::ofstream myfile;
-            myfile.open(filename.c_str());
-            if (!myfile.is_open())
-            {
-                std::cout << filename << " cannot be opened" << std::endl;
-                return false;
-            }
-
-            myfile << "OFF" << std::endl;
-            myfile << (vertices.size()) << " " << triangles.size() << " 0" << std::endl;
-
-            for( unsigned int v = 0 ; v < vertices.size() ; ++v )
-            {
-                myfile << (vertices[v]) << std::endl;
-            }
-
-            for( unsigned int t = 0 ; t < triangles.size() ; ++t )
-            {
-                myfile << "3 " << (triangles[t][0]) << " " << (triangles[t][1]) << " " << (triangles[t][2]) << std::endl;
-            }
-
-
-            myfile.close();
-    return true;
-    }
-
-}
-
 namespace MeshTools{
     template <typename Point>
             void computeAveragePosAndRadius ( const std::vector<Point> & points, Point & center, double & radius){
@@ -1,4 +1,5 @@
 #include "Mesh.h"
+#include "MeshAdjacency.h"
 #include <algorithm>
 #include <float.h>
 void Mesh::computeBB(){
@@ -85,94 +86,6 @@ void Mesh::computeVerticesNormals(){
     }
 }
 
-void Mesh::collectOneRing (std::vector< std::vector<unsigned int> > & oneRing) const {
-    oneRing.resize (vertices.size ());
-    for (unsigned int i = 0; i < triangles.size (); i++) {
-        const Triangle & ti = triangles[i];
-        for (unsigned int j = 0; j < 3; j++) {
-            unsigned int vj = ti.getVertex (j);
-            for (unsigned int k = 1; k < 3; k++) {
-                unsigned int vk = ti.getVertex ((j+k)%3);
-                if (std::find (oneRing[vj].begin (), oneRing[vj].end (), vk) == oneRing[vj].end ())
-                    oneRing[vj].push_back (vk);
-            }
-        }
-    }
-}
-
-void Mesh::glTriangle(unsigned int i){
-
-    const Triangle & t = triangles[i];
-    for( int j = 0 ; j < 3 ; j++ ){
-        glNormal(verticesNormals[t.getVertex(j)]*normalDirection);
-        glVertex(vertices[t.getVertex(j)]);
-    }
-    
-}
-
-
-void Mesh::sortFaces( FacesQueue & facesQueue ){
-    float modelview[16];
-    glGetFloatv(GL_MODELVIEW_MATRIX , modelview);
-    
-    
-    for (unsigned int t = 0 ; t < triangles.size() ; ++t )
-    {
-        Vec3Df _center = (
-                vertices[ triangles[t].getVertex(0) ]+
-                vertices[ triangles[t].getVertex(1) ]+
-                vertices[ triangles[t].getVertex(2) ]) / 3.f;
-        facesQueue.push( std::make_pair( modelview[2] * _center[0] + modelview[6] * _center[1] + modelview[10] * _center[2] + modelview[14] , t ) );
-    }
-    
-}
-
-void Mesh::draw( std::vector<bool> & selected, std::vector<bool> & fixed)
-{
-
-    glEnable(GL_DEPTH_TEST);
-    glEnable(GL_DEPTH);
-
-    glBegin (GL_TRIANGLES);
-
-    for(unsigned int i = 0 ; i < triangles.size(); i++){
-
-        int vi[3] = {triangles[i].getVertex(0), triangles[i].getVertex(1), triangles[i].getVertex(2)};
-        if( selected[ vi[0] ] && selected[ vi[1] ] && selected[ vi[2] ])
-            glColor3f( 0.8, 0.,0. );
-        if( fixed[ vi[0] ] && fixed[ vi[1] ] && fixed[ vi[2] ])
-            glColor3f( 0., 0.8,0. );
-        else
-            glColor3f(0.37,0.55,0.82);
-        glTriangle( i );
-
-    }
-
-    glEnd();
-
-    glDisable(GL_DEPTH_TEST);
-    glDisable(GL_DEPTH);
-
-}
-
-
-void Mesh::draw()
-{
-    
-    glEnable(GL_DEPTH_TEST);
-    glEnable(GL_DEPTH);
-        
-    glBegin (GL_TRIANGLES);
-
-    for(unsigned int i = 0 ; i < triangles.size(); i++){
-
-        glTriangle( i);
-
-    }
-    
-    glEnd();
-    
-    glDisable(GL_DEPTH_TEST);
-    glDisable(GL_DEPTH);
-    
+void Mesh::collectOneRing (std::vector<unsigned int> & offsets, std::vector<unsigned int> & neighbors) const {
+    MeshAdjacency::oneRing (vertices.size (), triangles, offsets, neighbors);
 }
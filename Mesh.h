@@ -38,7 +38,8 @@ protected:
 
     void computeBB();
 
-    void collectOneRing (std::vector<std::vector<unsigned int> > & oneRing) const;
+    // one-ring of vertex i in neighbors[ offsets[i] .. offsets[i+1] [ (see MeshAdjacency.h)
+    void collectOneRing (std::vector<unsigned int> & offsets, std::vector<unsigned int> & neighbors) const;
 
     void computeTriangleNormals();
     Vec3Df computeTriangleNormal(int t);
@@ -0,0 +1,197 @@
+#include "MeshAdjacency.h"
+
+#include <algorithm>
+#include <cmath>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace MeshAdjacency
+{
+    // blocks of triangles bucketed in parallel, and triangles per block : the
+    // buckets need blockNb counters per vertex
+    static const int COUNTING_BLOCK_NB = 8;
+    static const int COUNTING_BLOCK_GRAIN = 16384;
+
+    // Half-edge in the bucket of its origin vertex. order = 6 * triangle +
+    // 2 * corner + side is the position of its appearance in the triangles.
+    struct HalfEdge {
+        unsigned int neighbor;
+        unsigned int order;
+        float weight;
+    };
+
+    static inline bool byNeighbor( const HalfEdge & a, const HalfEdge & b ){
+        return a.neighbor < b.neighbor || ( a.neighbor == b.neighbor && a.order < b.order );
+    }
+
+    static inline bool byOrder( const HalfEdge & a, const HalfEdge & b ){
+        return a.order < b.order;
+    }
+
+    // cot[c] : weight of the edge from corner c to corner c+1 in the triangle
+    static inline void cotangents( const std::vector< Vec3Df > & vertices, const Triangle & triangle, float * cot ){
+        Vec3Df p1 = vertices[triangle.getVertex(0)];
+        Vec3Df p2 = vertices[triangle.getVertex(1)];
+        Vec3Df p3 = vertices[triangle.getVertex(2)];
+
+        float e1sq = ( p2 - p1 ).getSquaredLength();
+        float e2sq = ( p2 - p3 ).getSquaredLength();
+        float e3sq = ( p3 - p1 ).getSquaredLength();
+
+        float e1e2 = Vec3Df::dotProduct( p2 - p1 , p3 - p2 );
+        float e2e3 = Vec3Df::dotProduct( p3 - p1 , p3 - p2 );
+        float e3e1 = Vec3Df::dotProduct( p2 - p1 , p3 - p1 );
+
+        cot[0] = e1sq / ( 2.f * std::sqrt( ( e2sq * e3sq / ( e2e3 * e2e3 ) ) - 1.f ) );
+        cot[1] = e2sq / ( 2.f * std::sqrt( ( e1sq * e3sq / ( e3e1 * e3e1 ) ) - 1.f ) );
+        cot[2] = e3sq / ( 2.f * std::sqrt( ( e2sq * e1sq / ( e1e2 * e1e2 ) ) - 1.f ) );
+    }
+
+    // weights and vertices are NULL for the adjacency alone
+    static void build( unsigned int vertexNb, const std::vector< Triangle > & triangles, const std::vector< Vec3Df > * vertices,
+                       std::vector< unsigned int > & offsets, std::vector< unsigned int > & neighbors,
+                       std::vector< float > * weights, unsigned int threadNb ){
+#ifdef _OPENMP
+        const int threads = threadNb > 0 ? (int)threadNb : omp_get_max_threads();
+#else
+        const int threads = 1;
+#endif
+        const int triangleNb = triangles.size();
+        const int n = vertexNb;
+
+        // the half-edges are bucketed by blocks of triangles, at most
+        // COUNTING_BLOCK_NB of them whatever the number of threads since each
+        // one needs a counter per vertex
+        const int blockNb = std::max( 1, std::min( std::min( threads, COUNTING_BLOCK_NB ), triangleNb / COUNTING_BLOCK_GRAIN ) );
+
+        // buckets of the half-edges leaving each vertex, two per corner
+        std::vector< unsigned int > bucketOffsets( n + 1, 0 );
+        std::vector< HalfEdge > halfEdges;
+        // half-edges of each block leaving each vertex, then the position
+        // of the first of them in the bucket of the vertex
+        std::vector< unsigned int > blockCounts( (size_t)blockNb * n, 0 );
+        // number of distinct neighbors of each vertex
+        std::vector< unsigned int > uniqueNb( n );
+
+#pragma omp parallel num_threads(threads)
+        {
+            // every block of triangles is bucketed by one thread : the
+            // half-edges are counted per vertex, the counts of the blocks are
+            // summed per vertex, then each block writes its half-edges after
+            // the ones of the previous blocks. No atomics, and the half-edges
+            // enter their bucket in the order of the triangles
+#pragma omp for schedule(static, 1)
+            for( int b = 0 ; b < blockNb ; b++ ){
+                const int first = ( (long long)triangleNb * b ) / blockNb;
+                const int last = ( (long long)triangleNb * ( b + 1 ) ) / blockNb;
+                unsigned int * counts = blockCounts.data() + (size_t)b * n;
+                for( int t = first ; t < last ; t++ )
+                    for( int c = 0 ; c < 3 ; c++ )
+                        counts[triangles[t].getVertex(c)] += 2;
+            }
+
+#pragma omp for schedule(static)
+            for( int i = 0 ; i < n ; i++ ){
+                unsigned int size = 0;
+                for( int b = 0 ; b < blockNb ; b++ ){
+                    unsigned int & count = blockCounts[(size_t)b * n + i];
+                    unsigned int start = size;
+                    size += count;
+                    count = start;
+                }
+                bucketOffsets[i + 1] = size;
+            }
+
+#pragma omp single
+            {
+                for( int i = 0 ; i < n ; i++ )
+                    bucketOffsets[i+1] += bucketOffsets[i];
+                halfEdges.resize( bucketOffsets[n] );
+            }
+
+#pragma omp for schedule(static, 1)
+            for( int b = 0 ; b < blockNb ; b++ ){
+                const int first = ( (long long)triangleNb * b ) / blockNb;
+                const int last = ( (long long)triangleNb * ( b + 1 ) ) / blockNb;
+                unsigned int * counts = blockCounts.data() + (size_t)b * n;
+                for( int t = first ; t < last ; t++ ){
+                    const Triangle & triangle = triangles[t];
+                    float cot[3] = { 0.f, 0.f, 0.f };
+                    if( vertices != NULL )
+                        cotangents( *vertices, triangle, cot );
+
+                    for( int c = 0 ; c < 3 ; c++ ){
+                        unsigned int vj = triangle.getVertex(c);
+
+                        // the edges (c, c+1) and (c+2, c)
+                        for( int k = 1 ; k < 3 ; k++ ){
+                            HalfEdge & halfEdge = halfEdges[bucketOffsets[vj] + counts[vj]++];
+                            halfEdge.neighbor = triangle.getVertex( ( c + k ) % 3 );
+                            halfEdge.order = 6 * t + 2 * c + k - 1;
+                            halfEdge.weight = cot[ ( k == 1 ) ? c : ( c + 2 ) % 3 ];
+                        }
+                    }
+                }
+            }
+
+            // merge the half-edges of a bucket going to the same neighbor : the
+            // first one gives the position in the one-ring, the weights are
+            // averaged in the order of the triangles
+#pragma omp for schedule(dynamic, 1024)
+            for( int i = 0 ; i < n ; i++ ){
+                HalfEdge * begin = halfEdges.data() + bucketOffsets[i];
+                HalfEdge * end = halfEdges.data() + bucketOffsets[i+1];
+                std::sort( begin, end, byNeighbor );
+
+                HalfEdge * unique = begin;
+                for( HalfEdge * h = begin ; h != end ; ++h ){
+                    if( h != begin && h->neighbor == ( unique - 1 )->neighbor ){
+                        ( unique - 1 )->weight = ( ( unique - 1 )->weight + h->weight ) / 2.;
+                    } else {
+                        *unique = *h;
+                        ++unique;
+                    }
+                }
+
+                std::sort( begin, unique, byOrder );
+                uniqueNb[i] = unique - begin;
+            }
+
+#pragma omp single
+            {
+                offsets.resize( n + 1 );
+                offsets[0] = 0;
+                for( int i = 0 ; i < n ; i++ )
+                    offsets[i+1] = offsets[i] + uniqueNb[i];
+
+                neighbors.resize( offsets[n] );
+                if( weights != NULL )
+                    weights->resize( offsets[n] );
+            }
+
+#pragma omp for schedule(static)
+            for( int i = 0 ; i < n ; i++ ){
+                const HalfEdge * bucket = halfEdges.data() + bucketOffsets[i];
+                for( unsigned int h = 0 ; h < uniqueNb[i] ; h++ ){
+                    neighbors[offsets[i] + h] = bucket[h].neighbor;
+                    if( weights != NULL )
+                        (*weights)[offsets[i] + h] = bucket[h].weight;
+                }
+            }
+        }
+    }
+
+    void oneRing( unsigned int vertexNb, const std::vector< Triangle > & triangles,
+                  std::vector< unsigned int > & offsets, std::vector< unsigned int > & neighbors,
+                  unsigned int threadNb ){
+        build( vertexNb, triangles, NULL, offsets, neighbors, NULL, threadNb );
+    }
+
+    void cotangentOneRing( const std::vector< Vec3Df > & vertices, const std::vector< Triangle > & triangles,
+                           std::vector< unsigned int > & offsets, std::vector< unsigned int > & neighbors,
+                           std::vector< float > & weights, unsigned int threadNb ){
+        build( vertices.size(), triangles, &vertices, offsets, neighbors, &weights, threadNb );
+    }
+}
@@ -0,0 +1,36 @@
+#ifndef MESHADJACENCY_H
+#define MESHADJACENCY_H
+
+#include "Vec3D.h"
+#include "Triangle.h"
+
+#include <vector>
+
+// Vertex adjacency of a triangle mesh in CSR layout, shared by Mesh and
+// AsRigidAsPossible : the neighbors of vertex i are
+// neighbors[ offsets[i] .. offsets[i+1] [, in the order of their first
+// appearance in the triangles (triangle order, then corner order).
+//
+// Built without any map : the half-edges of the triangles are bucketed by
+// origin vertex with a counting sort, then every bucket is sorted by neighbor
+// to merge the duplicates. Both passes run on threadNb threads (0 : the
+// OpenMP default), the first one on at most 8 blocks of triangles with a
+// counter per block and vertex, the second one on ranges of vertices, and
+// the result does not depend on the number of threads. Triangle indices are limited to
+// 2^32 / 6.
+
+namespace MeshAdjacency
+{
+    void oneRing( unsigned int vertexNb, const std::vector< Triangle > & triangles,
+                  std::vector< unsigned int > & offsets, std::vector< unsigned int > & neighbors,
+                  unsigned int threadNb = 0 );
+
+    // Same, with weights[h] the cotangent weight of the edge of half-edge h :
+    // the cotangent of the angle opposite to the edge in its first triangle,
+    // averaged with the one of each next triangle sharing the edge.
+    void cotangentOneRing( const std::vector< Vec3Df > & vertices, const std::vector< Triangle > & triangles,
+                           std::vector< unsigned int > & offsets, std::vector< unsigned int > & neighbors,
+                           std::vector< float > & weights, unsigned int threadNb = 0 );
+}
+
+#endif // MESHADJACENCY_H
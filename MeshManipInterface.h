@@ -19,14 +19,19 @@
 #include "Manipulator.h"
 
 #include "AsRigidAsPossible.h"
+#include "ARAPSolverThread.h"
 
-enum MeshModificationMode {INTERACTIVE , REALTIME};
+enum MeshModificationMode {INTERACTIVE , REALTIME , PROGRESSIVE};
 
 
 /*
   HOW TO USE IT :
   You don't need to specify anything when constructing the object , but use :
-        setMode( int m ) to specify if you want INTERACTIVE or REALTIME
+        setMode( int m ) to specify if you want INTERACTIVE, REALTIME or PROGRESSIVE
+  In REALTIME and PROGRESSIVE modes the deformation is solved on a thread of its own :
+        setDeformationCallback( f ) to be notified, then fetchDeformation()
+  PROGRESSIVE delivers a one iteration deformation at once, then refines it
+  while the manipulator does not move, until isDeformationConverged().
 
   Then just fill the mesh, call reInitialize(),
   and you're done.
@@ -65,6 +70,15 @@ class MMInterface
 
     AsRigidAsPossible ARAP;
 
+    // REALTIME and PROGRESSIVE deformations, declared after ARAP which it uses
+    ARAPSolverThread solverThread;
+
+    // report of the deformation in modified_vertices
+    unsigned int iterationsUsed;
+    double energy;
+    AsRigidAsPossible::Stats stats;
+    bool converged;
+
     GLuint sphere_index;
 
     float sphere_scale ;
@@ -118,6 +132,7 @@ public:
     }
 
     void setIterationNb( unsigned int itNb){
+        solverThread.wait();
         ARAP.setIterationNb(itNb);
     }
 
@@ -125,12 +140,84 @@ public:
         return ARAP.getIterationNb();
     }
 
-    MMInterface()
+    void setTolerance( double tolerance ){
+        solverThread.wait();
+        ARAP.setTolerance(tolerance);
+    }
+
+    double getTolerance( ){
+        return ARAP.getTolerance();
+    }
+
+    void setAndersonWindow( unsigned int m ){
+        solverThread.wait();
+        ARAP.setAndersonWindow(m);
+    }
+
+    unsigned int getAndersonWindow( ){
+        return ARAP.getAndersonWindow();
+    }
+
+    // taken into account when the next mesh is loaded
+    void setLevelNb( unsigned int levels ){
+        solverThread.wait();
+        ARAP.setLevelNb(levels);
+    }
+
+    unsigned int getLevelNb( ){
+        return ARAP.getLevelNb();
+    }
+
+    void setRotationClusterSize( unsigned int size ){
+        solverThread.wait();
+        ARAP.setRotationClusterSize(size);
+    }
+
+    unsigned int getRotationClusterSize( ){
+        return ARAP.getRotationClusterSize();
+    }
+
+    unsigned int getIterationsUsed( ){
+        return iterationsUsed;
+    }
+
+    double getEnergy( ){
+        return energy;
+    }
+
+    const AsRigidAsPossible::Stats & getStats( ){
+        return stats;
+    }
+
+    // false while a PROGRESSIVE deformation is still refined
+    bool isDeformationConverged( ){
+        return converged;
+    }
+
+    void setHardConstraints( bool hard ){
+        solverThread.wait();
+        ARAP.setConstraintMode( hard ? AsRigidAsPossible::HARD : AsRigidAsPossible::SOFT );
+    }
+
+    bool getHardConstraints( ){
+        return ARAP.getConstraintMode() == AsRigidAsPossible::HARD;
+    }
+
+    void setConjugateGradient( bool cg ){
+        solverThread.wait();
+        ARAP.setLinearSolver( cg ? AsRigidAsPossible::CONJUGATE_GRADIENT : AsRigidAsPossible::CHOLESKY );
+    }
+
+    bool getConjugateGradient( ){
+        return ARAP.getLinearSolver() == AsRigidAsPossible::CONJUGATE_GRADIENT;
+    }
+
+    MMInterface() : solverThread( ARAP )
     {
         deformationMode = REALTIME;
         average_edge_halfsize = 1.;
         sphere_scale = 1.;
-        ARAP = AsRigidAsPossible();
+        update_report();
     }
 
     ~MMInterface()
@@ -163,6 +250,41 @@ public:
     void setMode( int m )
     {
         deformationMode = MeshModificationMode(m);
+        solverThread.setProgressive( deformationMode == PROGRESSIVE );
+    }
+
+    MeshModificationMode getMode() const
+    {
+        return deformationMode;
+    }
+
+    // In REALTIME and PROGRESSIVE modes, changed() only posts the positions to the solver
+    // thread, which calls this function (on its own thread) each time a
+    // deformation is ready. Then call fetchDeformation() from your thread.
+    void setDeformationCallback( const std::function<void()> & callback )
+    {
+        solverThread.setPublishCallback( callback );
+    }
+
+    // Moves the newest deformation of the solver thread into the modified
+    // vertices, returns false if there is none since the last call. The
+    // handles keep their current positions : they may have been moved again
+    // since the positions of that deformation were posted.
+    bool fetchDeformation()
+    {
+        const ARAPSolverThread::Result * result = solverThread.acquire();
+        if( result == NULL ) return false;
+
+        const std::vector< bool > & handles = ARAP.getHandles();
+        for( unsigned int i = 0 ; i < modified_vertices.size() && i < result->positions.size() ; ++i )
+            if( i >= handles.size() || !handles[ i ] )
+                modified_vertices[ i ] = result->positions[ i ];
+
+        iterationsUsed = result->iterationsUsed;
+        energy = result->energy;
+        stats = result->stats;
+        converged = result->converged;
+        return true;
     }
 
     void drawPoints( std::vector< int > & pts )
@@ -176,6 +298,7 @@ public:
 
     void clear()
     {
+        discard_deformations();
 
         modified_vertices.clear();
 
@@ -189,6 +312,7 @@ public:
         visu_quads.clear();
 
         ARAP.clear();
+        update_report();
 
         average_edge_halfsize = 1.;
 
@@ -238,6 +362,8 @@ public:
         int n_vertices , n_faces , dummy_int;
         myfile >> n_vertices >> n_faces >> dummy_int;
 
+        discard_deformations();
+
         vertices.clear();
 
         selected_vertices.clear();
@@ -313,6 +439,7 @@ public:
 
         ARAP.clear();
         ARAP.init( modified_vertices, triangles );
+        update_report();
     }
 
     void loadAndInitialize(const std::vector<point_t> & _vertices , const std::vector<Triangle> & _triangles )
@@ -340,6 +467,7 @@ public:
 
         ARAP.clear();
         ARAP.init( modified_vertices, triangles );
+        update_report();
     }
 
     void addFace(int _v1, int _v2, int _v3){
@@ -710,7 +838,9 @@ public:
 
         manipulator->activate();
 
+        solverThread.wait();
         ARAP.setHandles(get_handles_vertices());
+        update_report();
     }
 
 
@@ -720,6 +850,8 @@ public:
 
         if(modified_vertices.size() != n_points) return;
 
+        discard_deformations();
+
         for( unsigned int i = 0 ; i < n_points ; ++i )
         {
             modified_vertices[ i ] = _vertices[i];
@@ -727,6 +859,7 @@ public:
 
         ARAP.clear();
         ARAP.init(modified_vertices, triangles);
+        update_report();
 
     }
 
@@ -747,9 +880,10 @@ public:
 
 
 
-        if( deformationMode == REALTIME )
+        // latest wins : positions still waiting for the solver are replaced
+        if( deformationMode == REALTIME || deformationMode == PROGRESSIVE )
         {
-            ARAP.compute_deformation(modified_vertices);
+            solverThread.post(modified_vertices);
         }
     }
 
@@ -760,7 +894,7 @@ public:
     {
 
         qglviewer::Vec p;
-        std::vector<bool> handles (false, vertices.size() );
+        std::vector<bool> handles ( vertices.size(), false );
 
         for( unsigned int i = 0 ; i < input_def.size() ; ++i )
         {
@@ -768,21 +902,54 @@ public:
             handles[ input_def[i].first ] = true;
         }
 
-        if( deformationMode == REALTIME )
+        if( deformationMode == REALTIME || deformationMode == PROGRESSIVE )
         {
+            discard_deformations();
             ARAP.setHandles( handles );
             ARAP.compute_deformation( modified_vertices );
+            update_report();
         }
     }
 
     // When you release the mouse after moving the manipulator, it sends you a SIGNAL.
-    // When it happens, call that function with the manipulator as the parameter, it will update everything :
-    void manipulatorReleased()
+    // When it happens, call that function, it will update everything
+    // and return true if the modified vertices changed :
+    bool manipulatorReleased()
     {
         if( deformationMode == INTERACTIVE )
         {
+           discard_deformations();
            ARAP.compute_deformation(modified_vertices);
+           update_report();
+           return true;
         }
+
+        // PROGRESSIVE : the refinement goes on, see setDeformationCallback
+        if( deformationMode == PROGRESSIVE )
+        {
+            return false;
+        }
+
+        // the last positions of the drag are solved before returning
+        solverThread.wait();
+        return fetchDeformation();
+    }
+
+protected:
+
+    void update_report()
+    {
+        iterationsUsed = ARAP.getIterationsUsed();
+        energy = ARAP.getEnergy();
+        stats = ARAP.getStats();
+        converged = true;
+    }
+
+    // lets the solver thread finish, its results are not fetched any more
+    void discard_deformations()
+    {
+        solverThread.wait();
+        solverThread.acquire();
     }
 
 };
@@ -0,0 +1,124 @@
+// The SIMD lanes are GCC vector extensions : closestRotation is inlined in
+// functions compiled for AVX2 or AVX-512, and the variant matching the CPU is
+// selected once at runtime, so the project itself keeps the default target.
+// The vectors never cross a non-inlined call, hence no ABI concern.
+#if defined(__GNUC__) && ( defined(__x86_64__) || defined(__i386__) )
+#define ROTATIONFITTING_X86_DISPATCH
+#pragma GCC diagnostic ignored "-Wpsabi"
+#endif
+
+#include "RotationFitting.h"
+
+#include <cstring>
+
+namespace RotationFitting
+{
+
+#ifdef ROTATIONFITTING_X86_DISPATCH
+
+    typedef float Float8 __attribute__((vector_size(32)));
+    typedef int Int8 __attribute__((vector_size(32)));
+    typedef float Float16 __attribute__((vector_size(64)));
+    typedef int Int16 __attribute__((vector_size(64)));
+
+    template<>
+    struct LaneTraits< Float8 > {
+        typedef float Scalar;
+        typedef Int8 Mask;
+        static ROTATIONFITTING_INLINE Float8 sqrt( const Float8 & x ){
+            Float8 r;
+            for( int k = 0 ; k < 8 ; k++ )
+                r[k] = __builtin_sqrtf( x[k] );
+            return r;
+        }
+    };
+
+    template<>
+    struct LaneTraits< Float16 > {
+        typedef float Scalar;
+        typedef Int16 Mask;
+        static ROTATIONFITTING_INLINE Float16 sqrt( const Float16 & x ){
+            Float16 r;
+            for( int k = 0 ; k < 16 ; k++ )
+                r[k] = __builtin_sqrtf( x[k] );
+            return r;
+        }
+    };
+
+    // Processes the vertices of [0,count[ by packs of W and returns the number
+    // of vertices done.
+    template< typename T , unsigned int W >
+    ROTATIONFITTING_INLINE unsigned int closestRotationsLanes( const float * S , float * R , unsigned int count , unsigned int stride ){
+        unsigned int i = 0;
+        for( ; i + W <= count ; i += W ){
+            T s[9], r[9];
+            for( int k = 0 ; k < 9 ; k++ )
+                std::memcpy( &s[k], S + k*stride + i, sizeof(T) );
+            closestRotation( s, r );
+            for( int k = 0 ; k < 9 ; k++ )
+                std::memcpy( R + k*stride + i, &r[k], sizeof(T) );
+        }
+        return i;
+    }
+
+    __attribute__((target("avx512f")))
+    static unsigned int closestRotationsAVX512( const float * S , float * R , unsigned int count , unsigned int stride ){
+        return closestRotationsLanes< Float16, 16 >( S, R, count, stride );
+    }
+
+    __attribute__((target("avx2,fma")))
+    static unsigned int closestRotationsAVX2( const float * S , float * R , unsigned int count , unsigned int stride ){
+        return closestRotationsLanes< Float8, 8 >( S, R, count, stride );
+    }
+
+    enum InstructionSet { SCALAR, AVX2, AVX512 };
+
+    static InstructionSet detectInstructionSet(){
+        __builtin_cpu_init();
+        if( __builtin_cpu_supports( "avx512f" ) )
+            return AVX512;
+        if( __builtin_cpu_supports( "avx2" ) && __builtin_cpu_supports( "fma" ) )
+            return AVX2;
+        return SCALAR;
+    }
+
+    static InstructionSet selectedInstructionSet(){
+        static InstructionSet instructionSet = detectInstructionSet();
+        return instructionSet;
+    }
+
+#endif
+
+    void closestRotations( const float * S , float * R , unsigned int count , unsigned int stride ){
+
+        unsigned int done = 0;
+
+#ifdef ROTATIONFITTING_X86_DISPATCH
+        switch( selectedInstructionSet() ){
+        case AVX512 : done = closestRotationsAVX512( S, R, count, stride ); break;
+        case AVX2 : done = closestRotationsAVX2( S, R, count, stride ); break;
+        default : break;
+        }
+#endif
+
+        for( unsigned int i = done ; i < count ; i++ ){
+            float s[9], r[9];
+            for( int k = 0 ; k < 9 ; k++ )
+                s[k] = S[k*stride + i];
+            closestRotation( s, r );
+            for( int k = 0 ; k < 9 ; k++ )
+                R[k*stride + i] = r[k];
+        }
+    }
+
+    const char * instructionSet(){
+#ifdef ROTATIONFITTING_X86_DISPATCH
+        switch( selectedInstructionSet() ){
+        case AVX512 : return "avx512";
+        case AVX2 : return "avx2";
+        default : break;
+        }
+#endif
+        return "scalar";
+    }
+}
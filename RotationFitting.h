@@ -0,0 +1,175 @@
+#ifndef ROTATIONFITTING_H
+#define ROTATIONFITTING_H
+
+#include <cmath>
+#include <limits>
+
+// Allocation-free extraction of the rotation closest to a 3x3 matrix, used by
+// the local step of AsRigidAsPossible in place of the GSL SVD.
+//
+// All matrices are row-major T[9]. For a covariance S = U Sigma V^T the result
+// is R = V U^T, with the sign of the smallest singular direction flipped when
+// needed so that det(R) = 1.
+//
+// The SVD is obtained from a fixed number of cyclic Jacobi sweeps on S^T S,
+// and U is rebuilt from S V by Gram-Schmidt and a cross product, so rank
+// deficient covariances (planar or collinear one-rings) are handled without
+// special cases. The code has no data dependent branches : T may be a scalar
+// or a SIMD vector holding one vertex per lane (see RotationFitting.cpp).
+
+#if defined(__GNUC__)
+#define ROTATIONFITTING_INLINE inline __attribute__((always_inline))
+#else
+#define ROTATIONFITTING_INLINE inline
+#endif
+
+namespace RotationFitting
+{
+    // Scalar type, comparison result type and square root of a lane type.
+    template< typename T >
+    struct LaneTraits {
+        typedef T Scalar;
+        typedef bool Mask;
+        static ROTATIONFITTING_INLINE T sqrt( const T & x ){ return std::sqrt( x ); }
+    };
+
+    template< typename T >
+    ROTATIONFITTING_INLINE T broadcast( typename LaneTraits<T>::Scalar s ){ return T() + s; }
+
+    template< typename T >
+    ROTATIONFITTING_INLINE T absolute( const T & x ){ return x < T() ? -x : x; }
+
+    template< typename T , typename M >
+    ROTATIONFITTING_INLINE void conditionalSwap( const M & c , T & a , T & b ){
+        T tmp = a;
+        a = c ? b : a;
+        b = c ? tmp : b;
+    }
+
+    // Jacobi rotation annihilating B[p][q], accumulated in V.
+    template< typename T >
+    ROTATIONFITTING_INLINE void jacobiRotation( T B[3][3] , T V[3][3] , int p , int q ){
+        typedef typename LaneTraits<T>::Scalar Scalar;
+        typedef typename LaneTraits<T>::Mask Mask;
+        const int r = 3 - p - q;
+        const T zero = T(), one = broadcast<T>( 1 );
+
+        T bpq = B[p][q];
+        Mask skip = absolute( bpq ) < broadcast<T>( std::numeric_limits<Scalar>::min() );
+        T theta = ( B[q][q] - B[p][p] ) / ( broadcast<T>( 2 ) * ( skip ? one : bpq ) );
+        T t = ( theta < zero ? -one : one ) / ( absolute( theta ) + LaneTraits<T>::sqrt( theta * theta + one ) );
+        t = skip ? zero : t;
+        T c = one / LaneTraits<T>::sqrt( t * t + one );
+        T s = t * c;
+
+        B[p][p] -= t * bpq;
+        B[q][q] += t * bpq;
+        B[p][q] = B[q][p] = zero;
+
+        T brp = B[r][p], brq = B[r][q];
+        B[r][p] = B[p][r] = c * brp - s * brq;
+        B[r][q] = B[q][r] = s * brp + c * brq;
+
+        for( int i = 0 ; i < 3 ; i++ ){
+            T vip = V[i][p], viq = V[i][q];
+            V[i][p] = c * vip - s * viq;
+            V[i][q] = s * vip + c * viq;
+        }
+    }
+
+    template< typename T >
+    ROTATIONFITTING_INLINE void cross( const T a[3] , const T b[3] , T c[3] ){
+        c[0] = a[1] * b[2] - a[2] * b[1];
+        c[1] = a[2] * b[0] - a[0] * b[2];
+        c[2] = a[0] * b[1] - a[1] * b[0];
+    }
+
+    template< typename T >
+    ROTATIONFITTING_INLINE T dot( const T a[3] , const T b[3] ){
+        return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+    }
+
+    template< typename T >
+    ROTATIONFITTING_INLINE void closestRotation( const T * S , T * R , int sweeps = 4 ){
+        typedef typename LaneTraits<T>::Scalar Scalar;
+        typedef typename LaneTraits<T>::Mask Mask;
+        const T zero = T(), one = broadcast<T>( 1 );
+
+        // B = S^T S
+        T B[3][3];
+        for( int k = 0 ; k < 3 ; k++ )
+            for( int l = k ; l < 3 ; l++ )
+                B[k][l] = B[l][k] = S[k] * S[l] + S[3 + k] * S[3 + l] + S[6 + k] * S[6 + l];
+
+        T V[3][3] = { { one, zero, zero }, { zero, one, zero }, { zero, zero, one } };
+
+        for( int sweep = 0 ; sweep < sweeps ; sweep++ ){
+            jacobiRotation( B, V, 0, 1 );
+            jacobiRotation( B, V, 0, 2 );
+            jacobiRotation( B, V, 1, 2 );
+        }
+
+        // Singular directions by decreasing singular values
+        T v[3][3], lambda[3];
+        for( int k = 0 ; k < 3 ; k++ ){
+            lambda[k] = B[k][k];
+            for( int i = 0 ; i < 3 ; i++ )
+                v[k][i] = V[i][k];
+        }
+        for( int pass = 0 ; pass < 3 ; pass++ ){
+            int p = pass == 2 ? 1 : 0, q = pass == 0 ? 1 : 2;
+            Mask c = lambda[p] < lambda[q];
+            conditionalSwap( c, lambda[p], lambda[q] );
+            for( int i = 0 ; i < 3 ; i++ )
+                conditionalSwap( c, v[p][i], v[q][i] );
+        }
+        cross( v[0], v[1], v[2] );
+
+        // u1 = S v1 / |S v1|, u2 = orthogonalized S v2, u3 = u1 x u2 so that det(U) = det(V) = 1
+        T u[3][3], a[3], b[3];
+        for( int i = 0 ; i < 3 ; i++ ){
+            a[i] = S[3*i] * v[0][0] + S[3*i + 1] * v[0][1] + S[3*i + 2] * v[0][2];
+            b[i] = S[3*i] * v[1][0] + S[3*i + 1] * v[1][1] + S[3*i + 2] * v[1][2];
+        }
+
+        T n1 = LaneTraits<T>::sqrt( dot( a, a ) );
+        Mask rankZero = n1 < broadcast<T>( std::numeric_limits<Scalar>::min() );
+        T inv1 = one / ( rankZero ? one : n1 );
+        for( int i = 0 ; i < 3 ; i++ )
+            u[0][i] = rankZero ? v[0][i] : a[i] * inv1;
+
+        // When S has rank one, any direction orthogonal to u1 is valid : use v2 or v3
+        const T tolerance = broadcast<T>( std::sqrt( std::numeric_limits<Scalar>::epsilon() ) );
+        T c2[3], c3[3];
+        T db = dot( u[0], b ), d2 = dot( u[0], v[1] ), d3 = dot( u[0], v[2] );
+        for( int i = 0 ; i < 3 ; i++ ){
+            b[i] -= db * u[0][i];
+            c2[i] = v[1][i] - d2 * u[0][i];
+            c3[i] = v[2][i] - d3 * u[0][i];
+        }
+        T nb = LaneTraits<T>::sqrt( dot( b, b ) ), n2 = LaneTraits<T>::sqrt( dot( c2, c2 ) ), n3 = LaneTraits<T>::sqrt( dot( c3, c3 ) );
+        Mask useB = nb > tolerance * n1 && !rankZero;
+        Mask useC2 = n2 > broadcast<T>( 0.5 );
+        T n = useB ? nb : ( useC2 ? n2 : n3 );
+        for( int i = 0 ; i < 3 ; i++ )
+            u[1][i] = ( useB ? b[i] : ( useC2 ? c2[i] : c3[i] ) ) / n;
+        cross( u[0], u[1], u[2] );
+
+        // R = V U^T
+        for( int r = 0 ; r < 3 ; r++ )
+            for( int c = 0 ; c < 3 ; c++ )
+                R[3*r + c] = v[0][r] * u[0][c] + v[1][r] * u[1][c] + v[2][r] * u[2][c];
+    }
+
+    // Batched version used by the local step. The covariances of count vertices
+    // are stored as a structure of arrays, S[k*stride + i] being coefficient k of
+    // vertex i, and the rotations are written with the same layout in R.
+    // Processes 16 (AVX-512) or 8 (AVX2) vertices at once when the CPU supports
+    // it, and falls back to the scalar kernel otherwise.
+    void closestRotations( const float * S , float * R , unsigned int count , unsigned int stride );
+
+    // Name of the instruction set selected at runtime by closestRotations.
+    const char * instructionSet();
+}
+
+#endif // ROTATIONFITTING_H
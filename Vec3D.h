@@ -25,7 +25,6 @@
 #include <cassert>
 #include <cstdlib>
 
-#include <QOpenGLFunctions>
 #include <float.h>
 
 #include <cmath>
@@ -307,15 +306,6 @@ typedef Vec3D<float> Vec3Df;
 typedef Vec3D<double> Vec3Dd;
 typedef Vec3D<int> Vec3Di;
 
-inline void glVertex( Vec3Df const & p )
-{
-    glVertex3f( p[0] , p[1] , p[2] );
-}
-
-inline void glNormal( Vec3Df const & p )
-{
-    glNormal3f( p[0] , p[1] , p[2] );
-}
 // Some Emacs-Hints -- please don't remove:
 //
 //  Local Variables:
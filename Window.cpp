@@ -99,6 +99,61 @@ void Window::initDisplayDockWidgets(){
 
     deformationGroupBoxLayout->addWidget(arapSpinBox);
 
+    QLabel * arapToleranceLabel = new QLabel("ARAP tolerance (0 : fixed iteration number)");
+    deformationGroupBoxLayout->addWidget(arapToleranceLabel);
+    QDoubleSpinBox * arapToleranceSpinBox = new QDoubleSpinBox();
+    arapToleranceSpinBox->setDecimals( 5 );
+    arapToleranceSpinBox->setSingleStep(0.0001);
+    arapToleranceSpinBox->setValue( viewer->getARAPTolerance() );
+    connect (arapToleranceSpinBox, SIGNAL(valueChanged(double)), viewer, SLOT(setARAPTolerance(double)));
+
+    deformationGroupBoxLayout->addWidget(arapToleranceSpinBox);
+
+    QLabel * andersonLabel = new QLabel("Anderson acceleration window (0 : off)");
+    deformationGroupBoxLayout->addWidget(andersonLabel);
+    QSpinBox * andersonSpinBox = new QSpinBox();
+    andersonSpinBox->setRange( 0, 20 );
+    andersonSpinBox->setValue( viewer->getARAPAndersonWindow() );
+    connect (andersonSpinBox, SIGNAL(valueChanged(int)), viewer, SLOT(setARAPAndersonWindow(int)));
+
+    deformationGroupBoxLayout->addWidget(andersonSpinBox);
+
+    QLabel * levelLabel = new QLabel("ARAP multiresolution levels (next mesh loaded)");
+    deformationGroupBoxLayout->addWidget(levelLabel);
+    QSpinBox * levelSpinBox = new QSpinBox();
+    levelSpinBox->setRange( 1, 8 );
+    levelSpinBox->setValue( viewer->getARAPLevelNb() );
+    connect (levelSpinBox, SIGNAL(valueChanged(int)), viewer, SLOT(setARAPLevelNb(int)));
+
+    deformationGroupBoxLayout->addWidget(levelSpinBox);
+
+    QLabel * rotationClusterLabel = new QLabel("Vertices per ARAP rotation (1 : one per vertex)");
+    deformationGroupBoxLayout->addWidget(rotationClusterLabel);
+    QSpinBox * rotationClusterSpinBox = new QSpinBox();
+    rotationClusterSpinBox->setRange( 1, 256 );
+    rotationClusterSpinBox->setValue( viewer->getARAPRotationClusterSize() );
+    connect (rotationClusterSpinBox, SIGNAL(valueChanged(int)), viewer, SLOT(setARAPRotationClusterSize(int)));
+
+    deformationGroupBoxLayout->addWidget(rotationClusterSpinBox);
+
+    QCheckBox * hardConstraintsCheckBox = new QCheckBox("Hard handle constraints");
+    hardConstraintsCheckBox->setChecked( viewer->getARAPHardConstraints() );
+    connect (hardConstraintsCheckBox, SIGNAL(toggled(bool)), viewer, SLOT(setARAPHardConstraints(bool)));
+
+    deformationGroupBoxLayout->addWidget(hardConstraintsCheckBox);
+
+    QCheckBox * conjugateGradientCheckBox = new QCheckBox("Conjugate gradient solver (no factorization)");
+    conjugateGradientCheckBox->setChecked( viewer->getARAPConjugateGradient() );
+    connect (conjugateGradientCheckBox, SIGNAL(toggled(bool)), viewer, SLOT(setARAPConjugateGradient(bool)));
+
+    deformationGroupBoxLayout->addWidget(conjugateGradientCheckBox);
+
+    QCheckBox * progressiveCheckBox = new QCheckBox("Progressive refinement (1 iteration, refined while idle)");
+    progressiveCheckBox->setChecked( viewer->getARAPProgressive() );
+    connect (progressiveCheckBox, SIGNAL(toggled(bool)), viewer, SLOT(setARAPProgressive(bool)));
+
+    deformationGroupBoxLayout->addWidget(progressiveCheckBox);
+
     contentLayout->addWidget(deformationGroupBox);
     contentLayout->addStretch(0);
 